@@ -3,6 +3,20 @@
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include "p1.h"
 
 
 /*
@@ -15,15 +29,145 @@
     lowercase label detection
     printing of register $t and $s
     printing of piplined instruction
+    fine-grained multithreading of several programs in one pipeline
+    static scheduling of basic blocks to fill the slots of data hazards
+    attribution of lost cycles to the instructions causing them
+    time series of performance counters in CSV or JSON lines
+    timelines in the formats of Chrome trace and Konata
+    binary timelines with an index for queries
+    capture of executed instructions and timing-only replay of them
+    streams of executed instructions without a limit of cycles
+    fast-forward of loops in a steady state of the pipeline
+    detection of programs which never end by hashing their states
+    hazards of the pipeline checked on the decoded operands
+    threaded code for the execution of the instructions
+    native x86-64 code of basic blocks for the execution without the pipeline
+    execution from many initial states in the lanes of vectors
+    a reentrant library of simulations on opaque handles
+    a daemon running the programs sent over a Unix domain socket
+    a cache of the results of runs on disk, by the content of the programs
+    watch of a program, simulated again from checkpoints when it is edited
+    formatting and printing of the frames of time on a thread of their own
+    journals of the changes in every frame, and the tables rebuilt from them
+    golden hashes of the state in every cycle, checked again in parallel
 */
 
 
 #define t_max 10                        // temporary register from $t0 to $t10
 #define s_max 8                         // saved register from $s0 to $s7
-#define cycle_max 16                    // max cycles is 16
-#define instruction_max 10              // max count of instructions is 10
+#define cycle_max 16                    // frames of time in w_table, and the
+                                        // default limit of cycles
+#define instruction_max 10              // max count of instructions in a
+                                        // block for static scheduling is 10
 #define buffer_size 128                 // the size of buffer is set to 128
+#define thread_max 4                    // max count of hardware threads is 4
+#define policy_rr 0                     // round-robin fetch between threads
+#define policy_icount 1                 // ICOUNT fetch between threads
+#define cause_raw 0                     // stall of read after write
+#define cause_control 1                 // flush after a taken branch
+#define cause_structural 2              // fetch taken by another thread
+#define counter_count 12                // count of counters in a sample
+#define trace_chrome 0                  // Chrome trace event format
+#define trace_konata 1                  // Kanata log of the Konata viewer
+#define stage_new -1                    // instruction not traced yet
+#define stage_end 7                     // instruction out of the pipeline
+#define snapshot_period 64              // cycles between register snapshots
+#define timeline_version 1              // version of the binary timeline
+#define tl_record_cycle 1               // a frame of time begins
+#define tl_record_enter 2               // an instruction enters the pipeline
+#define tl_record_stage 3               // an instruction changes its stage
+#define tl_record_write 4               // a register is written
+#define tl_record_snapshot 5            // all the registers
+#define capture_max (1 << 20)           // max instructions captured of a
+                                        // program which may never end
+#define id_ring (cycle_max << 3)        // dynamic numbers tracked at a time
+#define window_keep 8                   // frames of time kept when sliding
+#define stream_ring (cycle_max << 3)    // instructions of a stream kept
+#define stream_period 1000              // cycles between stream reports
+#define schedule_limit (1 << 20)       // cycles of a run compared by -s
+#define steady_max 8                    // states remembered to find loops
+#define steady_log (1 << 16)            // max instructions between two states
+#define steady_sig ((cycle_max << 2) * (window_keep + 2) + t_max + s_max + 2)
+                                        // max length of the state
+#define livelock_status 2               // exit status of a program never ending
+#define source_execute 0                // branches resolved by executing
+#define source_replay 1                 // outcomes of branches from a trace
+#define source_stream 2                 // outcomes of branches from a stream
+#define output_none 0                   // no cycle is printed or recorded
+#define output_print 1                  // the cycles are only printed
+#define output_record 2                 // the cycles are recorded, and may be
+                                        // printed
+#define op_add 0                        // operations of the threaded code, an
+#define op_addi 1                       // immediate is always the second
+#define op_and 2                        // operand
+#define op_andi 3
+#define op_or 4
+#define op_ori 5
+#define op_slt 6
+#define op_slti 7
+#define op_sgti 8                       // slti with the immediate first
+#define op_li 9                         // both operands are immediates
+#define op_beq 10
+#define op_beqi 11
+#define op_bne 12
+#define op_bnei 13
+#define op_jump 14                      // branch always taken
+#define op_skip 15                      // branch never taken
+#define op_end 16                       // after the last instruction
+#define op_count 17
+// op_branch() is 1 for the operations of a branch
+#define op_branch(code) ((code) >= op_beq && (code) <= op_skip)
+// add_wrap() is the sum of two registers, which wraps around at 32 bits
+#define add_wrap(a, b) ((int)((unsigned)(a) + (unsigned)(b)))
+#define operand_zero 0                  // $zero, which reads 0 and is not
+                                        // written
+#define operand_register 1              // from $t0 to $t9 or $s0 to $s7
+#define operand_immediate 2             // a decimal int
+#define slot_zero (t_max + s_max)       // slot of $zero in the threaded code
+#define slot_sink (t_max + s_max + 1)   // slot written instead of $zero
+#define slot_count (t_max + s_max + 2)  // slots of registers in the threaded code
+#define bench_budget (1 << 24)          // max instructions of a benchmark run
+#define exec_text 0                     // execution by parsing the text
+#define exec_threaded 1                 // execution of the threaded code
+#define exec_native 2                   // execution of the native code
+#define simd_width 8                    // lanes of a vector, 8 ints in AVX2
+#define jit_op_max 64                   // max bytes of native code for an
+                                        // instruction and its block
+#define chunk_max 64                    // max count of chunks for loading
+#define chunk_min (1 << 20)             // min size of a chunk is 1 MB
 const char nop[4] = "nop";              // string for no operation
+const char *counter_name[counter_count] = {"cycles", "retired", "bubbles",
+  "flushed", "forwarded", "taken", "not_taken", "if", "id", "ex", "mem", "wb"};
+const char *stage_name[7] = {".", "IF", "ID", "EX", "MEM", "WB", "*"};
+const char timeline_magic[4] = {'P', '1', 'T', 'L'};
+const char replay_magic[4] = {'P', '1', 'T', 'R'};
+const char golden_magic[4] = {'P', '1', 'G', 'H'};
+#if defined(__GNUC__) && !defined(threaded_switch)
+#define threaded_goto                   // dispatch by the labels as values
+#endif
+#if defined(__GNUC__) && !defined(simd_scalar)
+#define simd_vector                     // vectors of the GNU C extension
+typedef int lanes __attribute__((vector_size(simd_width * sizeof(int))));
+#endif
+#define nop_handle -1                   // handle of nop in the working window
+#define daemon_cache 64                 // decoded programs kept by the daemon
+#define daemon_clients 256              // connections open at a time
+#define daemon_text_max (1 << 26)       // max bytes of a program in a request
+#define result_suffix ".p1r"            // file name of a cached result
+#define watch_period 1024               // cycles between checkpoints of a run
+#define watch_poll 100                  // ms between checks of a watched file
+#define writer_ring (1 << 16)           // records in the ring of the writer
+#define record_frame 0                  // base and count of rows of a frame
+#define record_shift 1                  // the window slides by some columns
+#define record_row 2                    // thread and instruction of a row
+#define record_cell 3                   // stage in a row and a column
+#define record_reg 4                    // value of a register of a thread
+#define record_print 5                  // the frame is complete
+#define golden_version 1                // version of the golden hashes
+#define golden_suffix ".golden"         // file name of a golden run
+#define golden_stages 1                 // the stages of the rows differ
+#define golden_regs 2                   // the registers differ
+#define golden_end 4                    // the run ends at another cycle
 
 
 struct registers {
@@ -35,102 +179,1432 @@ struct registers {
 //    register.        "$t0", "$s0".            the register.     //
 };
 
+struct token {
+  int off;                              // offset of the token in the text
+  int len;                              // length of the token
+};
+
+struct line {
+  struct token t[4];                    // operation and operands, or label
+  int label;                            // 1 if the line is a label
+  int number;                           // line number in the file
+};
+
+struct op {
+  const void *handler;                  // label of the operation in
+                                        // threaded_run() with computed goto
+  int code;                             // operation
+  int rd;                               // slot of the destination
+  int a;                                // slot of the first operand
+  int b;                                // slot or immediate of the second one
+  int target;                           // next instruction if taken
+  int lead;                             // slot of the first operand in the
+                                        // text (the destination of an
+                                        // operation), or -1 for an immediate
+                                        // or $zero
+  int use[2];                           // slots of the registers read, in the
+                                        // order of the text, or -1
+};
+
+struct states {
+  int count;                            // count of states
+  int (*value)[t_max + s_max];          // $t0 to $t9 and $s0 to $s7 of every
+                                        // state, as the slots
+};
+
 struct instructions {
-  char w_ins[16][128];                  // working instructions
-  char o_ins[10][128];                  // original instructions
-  char le_ins[10][128];                 // label excluded instructions
-  char l[10][128];                      // name of the labels
-  int l_pos[10];                        // position that label points to
+  const char *text;                     // program text mapped from the file
+  size_t size;                          // size of the program text
+  struct line *o_ins;                   // original instructions
+  int *le_ins;                          // label excluded instructions, as
+                                        // the index of their line in o_ins
+  int *l;                               // lines of the labels
+  int *l_pos;                           // position that label points to
+  int *target;                          // position that branch jumps to
+  char *pool;                           // interned text of the instructions
+  int pool_size;                        // size of the string pool
+  int *le_text;                         // handle of the text of instruction,
+                                        // which is its offset in the pool
   int le_count;                         // label excluded instructions count
   int o_count;                          // original instructions count
   int l_count;                          // count of labels
+  struct op *op;                        // threaded code of the instructions,
+                                        // and op_end after them
+  unsigned char *jit;                   // native code of the instructions
+  size_t jit_size;                      // size of the pages of native code
+  int *jit_entry;                       // offset of the native code of every
+                                        // block, or -1 inside a block
+};
+
+struct chunk {
+  struct instructions *ins;             // program that is being loaded
+  int begin;                            // first byte, line or instruction
+  int end;                              // end of the range of this chunk
+  struct line *o_ins;                   // lines lexed in this chunk
+  int o_count;                          // count of lines lexed in this chunk
+  int o_base;                           // first line of this chunk in ins
+  int newlines;                         // count of newlines in this chunk
+  int number;                           // line number before this chunk
+  int error;                            // line number of invalid instruction
+  int nomem;                            // 1 if an allocation failed
+  int le_count;                         // instructions in this chunk
+  int le_base;                          // first instruction of this chunk
+  int l_count;                          // labels in this chunk
+  int l_base;                           // first label of this chunk
+  int *h_label;                         // hash table of the labels
+  int h_size;                           // size of the hash table
+  char *pool;                           // string pool of this chunk
+  int pool_size;                        // size of the string pool
+  int pool_base;                        // first byte of this chunk in pool
+};
+
+struct working {
+  struct instructions *ins;             // programs of the hardware threads
+  int w_ins[cycle_max << 2];            // working instructions, as handles
+                                        // into the string pool of the thread
+  int w_tid[cycle_max << 2];            // hardware thread of each instruction
+  int w_pc[cycle_max << 2];             // position of each instruction in the
+                                        // label excluded instructions, or -1
+  int w_id[cycle_max << 2];             // dynamic number of each instruction
+  int next_id;                          // dynamic number of the next one
   int w_count;                          // count of working instructions
+  int threads;                          // count of hardware threads
+  int base;                             // frames of time slid out of w_table
+};
+
+struct hotspot {
+  int tid;                              // hardware thread of the instruction
+  int pc;                               // position of the instruction
+  int cause;                            // cause of the lost cycles
+  int detail;                           // register of RAW, or -1
+  long long cycles;                     // cycles lost, 0 for an empty slot
+};
+
+struct profile {
+  struct hotspot *entry;                // hash table of the hot spots
+  int size;                             // size of the hash table
+  int count;                            // count of the hot spots
+};
+
+struct counters {
+  long long cycles;                     // cycles simulated
+  long long retired;                    // instructions in WB
+  long long bubbles;                    // nops inserted for data hazards
+  long long flushed;                    // instructions invalidated by branches
+  long long forwarded;                  // operands taken from EX/MEM or MEM/WB
+  long long taken;                      // branches taken
+  long long not_taken;                  // branches not taken
+  long long occupancy[5];               // cycles of instructions in IF to WB
+};
+
+struct series {
+  FILE *out;                            // file of the time series
+  int period;                           // cycles between two samples
+  int json;                             // 1 for JSON lines, 0 for CSV
+  struct counters now;                  // counters of the simulation
+  struct counters last;                 // counters at the last sample
+};
+
+struct trace {
+  FILE *out;                            // file of the trace
+  int format;                           // trace_chrome or trace_konata
+  int owner[id_ring];                   // dynamic number in each slot
+  int stage[id_ring];                   // last stage traced, by dynamic number
+  int since[id_ring];                   // cycle that the last stage began
+  int events;                           // count of events written
+  int retired;                          // count of instructions retired
+};
+
+struct tl_entry {
+  int cycle;                            // cycle of the record
+  long long offset;                     // offset of the record in the file
+};
+
+struct timeline {
+  FILE *out;                            // file of the timeline
+  long long size;                       // bytes written
+  int threads;                          // count of hardware threads
+  int owner[id_ring];                   // dynamic number in each slot
+  int stage[id_ring];                   // last stage written, by dynamic number
+  int reg[thread_max][t_max + s_max];   // last registers written
+  struct tl_entry *cycle_index;         // snapshots by cycle
+  int cycle_count, cycle_size;
+  struct tl_entry *ins_index;           // entries by dynamic number
+  int ins_count, ins_size;
+};
+
+struct replay {
+  int *rec[thread_max];                 // instructions executed by each
+                                        // thread, as pc << 1 | taken
+  int count[thread_max];                // count of the instructions
+  int complete[thread_max];             // 1 if the program ran to its end
+  int threads;                          // count of hardware threads
+};
+
+struct stream {
+  FILE *in;                             // stdin or a FIFO of instructions
+  char pool[stream_ring * buffer_size]; // text of the latest instructions
+  int taken[stream_ring];               // 1 if the branch is taken
+  struct op op[stream_ring];            // the instructions decoded
+  int count;                            // count of instructions read
+  int line;                             // count of lines read
+  int eof;                              // 1 at the end of the stream
+  int error;                            // line of an invalid instruction
+  int last_cycles;                      // cycles at the last report
+  int last_retired;                     // instructions at the last report
+};
+
+struct config {
+  int forwarding;                       // 1 if forwarding is enabled
+  int threads;                          // count of hardware threads
+  int policy;                           // fetch policy between the threads
+  int verbose;                          // 1 if tables are printed every cycle
+  int schedule;                         // 1 if programs are only scheduled
+  int limit;                            // max cycles to simulate, 0 for none
+  int summary;                          // 1 if only a summary is printed
+  int journal;                          // 1 if only the changes of the
+                                        // tables are printed
+  FILE *report;                         // where the tables and the summary
+                                        // are printed
+  struct profile *prof;                 // attribution of stalls, or NULL
+  struct series *series;                // time series of counters, or NULL
+  struct trace *trace;                  // timeline for viewers, or NULL
+  struct timeline *timeline;            // binary timeline, or NULL
+  struct replay *replay;                // outcome of the branches instead of
+                                        // the execution, or NULL
+  struct stream *stream;                // instructions to time as they come
+                                        // in, or NULL
+  struct golden *golden;                // hashes of the state in every cycle,
+                                        // or NULL
+};
+
+struct stats {
+  int cycles;                           // cycles until the end of simulation
+  int retired[thread_max];              // instructions of each thread in WB
+  int nops;                             // nops inserted for data hazards
+  int flushed;                          // instructions invalidated by branches
+  int stalls;                           // cycles stalled by data hazards
+  int skipped;                          // iterations of loops fast-forwarded
+  int livelock;                         // count of threads never ending
+  int stuck_pc[thread_max];             // branch of the loop never ending
+  int stuck_period[thread_max];         // taken backward branches in a cycle
+  int stuck_cycle[thread_max];          // cycle when the loop is found
+};
+
+struct livelock {
+  unsigned long long hash;              // hash of the saved state
+  int pc;                               // taken backward branch of the state
+  int value[t_max + s_max];             // registers of the state
+  int power;                            // states until the next save
+  int lam;                              // states since the last save
+};
+
+struct snapshot {
+  int pc;                               // taken backward branch
+  int cycle;                            // cycle of the state
+  int log_pos;                          // instructions done before the state
+  int retired, nops, stalls, flushed;   // statistics at the state
+  int len;                              // length of the state
+  int sig[steady_sig];                  // state of the pipeline
+};
+
+struct steady {
+  struct snapshot snap[steady_max];     // latest states at backward branches
+  int count;                            // count of states
+  int next;                             // state to replace next
+  int *log;                             // instructions done in WB in order,
+  int log_count, log_size;              // as pc << 1 | taken
+};
+
+struct record {
+  int op;                               // record_frame, record_shift, ...
+  int a, b, c, d;                       // operands of the record
+};
+
+struct writer {
+  struct record ring[writer_ring];      // records sent by the simulation
+  unsigned head;                        // records published by the simulation
+  unsigned tail;                        // records applied by the writer
+  unsigned pushed;                      // records pushed by the simulation
+  int full;                             // 1 if the simulation waits for room
+  int empty;                            // 1 if the writer waits for records
+  int done;                             // 1 after the last frame
+  pthread_mutex_t lock;                 // only to wait on a full or an empty
+  pthread_cond_t wake;                  // ring
+  pthread_t thread;                     // writer thread
+  struct config *cfg;                   // options of the run
+  int src;                              // source of the branches of the run
+  struct working sent;                  // frame as the writer has it, kept
+  int sent_table[cycle_max << 2][cycle_max + 1]; // by the simulation to send
+  int sent_value[thread_max][t_max + s_max];     // only what changed
+  struct working wk;                    // frame kept by the writer to print,
+  int w_table[cycle_max << 2][cycle_max + 1];    // by applying the records
+  struct registers reg[thread_max];
+  int time;                             // frame of time in the window
+  int jr_id[cycle_max << 2];            // rows, base and registers of the
+  int jr_count, jr_base;                // last frame in the journal
+  int jr_value[thread_max][t_max + s_max];
+};
+
+struct golden {
+  FILE *out;                            // file to record the hashes, or NULL
+                                        // when they are checked
+  unsigned long long stages;            // rolling hashes of the stages of the
+  unsigned long long regs;              // rows and of the registers
+  int value[thread_max][t_max + s_max]; // registers of the last frame
+  unsigned *hash;                       // 16 bits of both hashes after every
+  int count, size;                      // cycle, recorded or expected
+  int cycles;                           // cycles hashed so far
+  int diverged;                         // first cycle which differs, or 0
+  int part;                             // golden_stages, golden_regs, ...
+  char *focus;                          // rows and registers of the cycle
+  size_t focus_size;                    // which differs
+};
+
+struct golden_job {
+  char name[buffer_size];               // file of the golden run
+  int failed;                           // 1 unless the run is the same
+  char *report;                         // what is printed of the run
+  size_t report_size;
+};
+
+struct golden_run {
+  const char *dir;                      // directory of the golden runs
+  struct golden_job *job;               // golden runs to check
+  int count;                            // count of golden runs
+  int next;                             // next golden run to check
+  pthread_mutex_t lock;                 // lock for next
+};
+
+struct machine {
+  struct registers *reg;                // register file of every thread
+  struct instructions *ins;             // program of every thread
+  struct config *cfg;                   // options of the run
+  struct stats *st;                     // statistics of the run
+  int time;                             // frame of time
+  int w_table[cycle_max << 2][cycle_max + 1];
+  // table for the pipelined execution. NOTE: the count of working instruction
+  // may exceeds cycle_max due to the insertion of nops
+  int w_done[cycle_max << 2];           // record the completion of instructions
+  int next_ins[thread_max];             // next instruction of each thread
+  int last;                             // thread that is fetched most recently
+  int cursor[thread_max];               // next record of the replayed trace
+  struct steady *ss;                    // states to find steady loops, or NULL
+  struct livelock lv[thread_max];       // states to find endless loops
+  struct working wk;                    // working instructions of all threads
+  struct counters *cnt;                 // counters of the time series, or NULL
+  int sample;                           // cycles left before the next sample
+                                        // of the counters
+  int *touch;                           // first cycle when every position of
+                                        // the program of one thread is
+                                        // checked for an instruction, or NULL
+  struct writer *wr;                    // writer of the frames, or NULL
+  // NOTE: 0 = ".", 1 = "IF", 2 = "ID", 3 = "EX", 4 = "MEM", 5 = "WB", 6 = "*"
+};
+
+struct p1_sim {
+  struct registers reg[thread_max];     // register file of every program
+  struct instructions ins[thread_max];  // loaded programs
+  struct config cfg;                    // options, nothing printed or recorded
+  struct stats st;                      // statistics of the run
+  struct machine m;                     // state of the pipeline
+  int started;                          // 1 after the first step
+  int ended;                            // 1 when every program is done or
+                                        // never ends
+};
+
+struct results {
+  const char *dir;                      // directory of the cache, or NULL
+  long long bound;                      // max bytes of all the results
+  int update;                           // 1 if the runs are not looked up,
+                                        // only stored
+  unsigned long long key;               // key of this run
+  char path[buffer_size * 8];           // result being written
+  FILE *out;                            // result being written, or NULL
+};
+
+struct result_head {
+  char magic[4];                        // "P1RC"
+  unsigned long long key;               // key of the run
+  int status;                           // exit status of the run
+  int rebuilt;                          // 1 if the output is not stored, but
+                                        // rebuilt from the statistics and the
+                                        // registers
+  struct stats st;                      // statistics of the run
+  int value[thread_max][t_max + s_max]; // registers at the end, $t then $s
+  long long output;                     // bytes of the output after this
+};
+
+struct result_file {
+  long long used;                       // time of the latest use, in ns
+  long long size;                       // bytes of the result
+  char name[buffer_size];               // file name in the cache
+};
+
+struct cached {
+  unsigned long long hash;              // FNV-1a of the text of the program
+  struct instructions ins;              // decoded program
+  int refs;                             // jobs running the program
+  int kept;                             // 1 while it is in the cache
+  unsigned long long used;              // time of the latest job
+};
+
+struct client {
+  int fd;                               // connection to the client
+  char ahead[buffer_size];              // bytes read ahead of the request
+  int have;                             // count of them
+};
+
+struct daemon {
+  struct client *queue[daemon_clients]; // connections with a request waiting
+  int head, count;                      // for a worker, first one and count
+  struct client *idle[daemon_clients];  // connections waiting for a request
+  int idle_count;                       // count of them
+  int clients;                          // connections open
+  int wake[2];                          // pipe to wake the poll of idle ones
+  struct cached *cache[daemon_cache];   // decoded programs by content, or NULL
+  unsigned long long clock;             // time of the jobs for the LRU
+  pthread_mutex_t lock;                 // lock of the connections and cache
+  pthread_cond_t ready;                 // a request is waiting
+};
+
+struct checkpoint {
+  struct machine m;                     // state of the pipeline
+  struct registers reg;                 // registers of the program
+  struct stats st;                      // statistics so far
+};
+
+struct watch {
+  const char *path;                     // file of the program
+  struct stat sb;                       // the file as it is loaded
+  struct instructions ins;              // program as it is loaded
+  struct registers reg;                 // registers of the run
+  struct config *cfg;                   // options of the run
+  struct stats st;                      // statistics of the run
+  struct machine m;                     // state of the pipeline
+  struct checkpoint *cp;                // state at every watch_period cycles
+  int cp_count, cp_size;                // from the start of the run
+  int *touch;                           // first cycle when every position is
+                                        // checked, INT_MAX if never
+  unsigned long long *frame;            // hash of the printed frame of every
+  int frame_count, frame_size;          // cycle, if the run is verbose
+};
+
+struct grid {
+  int forwarding[2];                    // forwarding settings to sweep
+  int n_forwarding;                     // count of forwarding settings
+  int schedule[2];                      // 1 for the scheduled program
+  int n_schedule;                       // count of schedule settings
+  int policy[2];                        // fetch policies to sweep
+  int n_policy;                         // count of fetch policies
+};
+
+struct point {
+  struct config cfg;                    // configuration of this run
+  int scheduled;                        // 1 if the programs are scheduled
+  struct instructions *ins;             // programs shared with other runs
+  struct stats st;                      // result of this run
+};
+
+struct sweep {
+  struct point *point;                  // configurations of the grid
+  int count;                            // count of configurations
+  int next;                             // next configuration to run
+  pthread_mutex_t lock;                 // lock for next
 };
 
 
 void data_init(struct registers *reg, struct instructions *ins);
-// data_init() will initialize the data in reg and ins
-void label_preprocess(struct instructions *ins);
+// data_init() will initialize the data in reg and ins, ins can be NULL when
+// only the registers need to be initialized
+int load_program(const char *path, struct instructions *ins);
+// load_program() will map the file at path into memory and lex it, and return
+// 0 on success, -1 if the file cannot be opened, -2 if out of memory, or the
+// line number of an invalid instruction
+int load_text(const char *text, long size, struct instructions *ins);
+// load_text() will do the same as load_program() on a copy of the text in
+// memory, and return -1 if out of memory
+int ins_lex(struct instructions *ins);
+// ins_lex() will split the program text at line boundaries into chunks, and
+// lex the chunks in parallel, and return 0 on success, -1 if out of memory,
+// or the line number of an invalid instruction
+void *lex_chunk(void *arg);
+// lex_chunk() will split the text of a chunk into lines of tokens in a single
+// pass, skipping whitespace, commas, comments and "\r"
+void *merge_chunk(void *arg);
+// merge_chunk() will move the lines of a chunk into the program and give them
+// their line number in the file
+int op_base(const char *op, int len);
+// op_base() will return the operation of the threaded code with registers for
+// the name of an instruction (op_add for add and addi, op_beq for beq, ...),
+// or -1 if the instruction is not supported
+int operand_kind(const char *v, int len);
+// operand_kind() will return operand_zero, operand_register or
+// operand_immediate for the token of an operand, or -1 if it is none of them
+int ins_valid(const char *const t[4], const int len[4]);
+// ins_valid() will return 1 if the tokens of a line are an instruction that
+// the simulator supports
+int label_check(struct instructions *ins);
+// label_check() will return the line number of the first branch to a label
+// which is not defined, or 0
+int label_preprocess(struct instructions *ins);
 // label_preprocess() will detect the labels in the instructions, and get
 // label excluded instructions, and record all the labels, and the location in
-// the final instructions that they are pointed to.
-void print_table(struct instructions *ins, int w_table[cycle_max << 2][cycle_max + 1]);
+// the final instructions that they are pointed to, and the location that
+// every branch jumps to. the lines are processed by chunks in parallel, and
+// 0 is returned, or -1 if out of memory
+void *count_chunk(void *arg);
+// count_chunk() will count the labels and instructions of a chunk of lines
+void *label_chunk(void *arg);
+// label_chunk() will record the labels and instructions of a chunk of lines
+void *target_chunk(void *arg);
+// target_chunk() will find the target of every branch in a chunk of
+// instructions
+int label_find(struct instructions *ins, int *h_label, int h_size,
+  struct token *t);
+// label_find() will return the slot of label t in the hash table h_label,
+// which is either the slot of the label or the empty slot for it
+int chunk_count(size_t size);
+// chunk_count() will return the count of chunks to process a program of size
+// bytes, which is one for every core, and one for a small program
+void run_chunks(struct chunk c[], int n, void *(*fn)(void *));
+// run_chunks() will run fn on n chunks in parallel and wait for all of them
+void program_free(struct instructions *ins);
+// program_free() will unmap the program text and free the instructions
+void *intern_chunk(void *arg);
+// intern_chunk() will write the text of every instruction in a chunk in the
+// form of op + ' ' + rd + ',' + rs + ',' + rt into the string pool of the
+// chunk, and the same text is only stored once
+void *pool_chunk(void *arg);
+// pool_chunk() will move the string pool of a chunk into the program and
+// update the handles of its instructions
+const char *ins_text(struct instructions *ins, int pos);
+// ins_text() will return the text of the label excluded instruction at pos
+const char *w_text(struct working *wk, int i);
+// w_text() will return the text of the working instruction i
+void print_table(FILE *report, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1]);
 // print_table() will print out the table for working instructions
-void print_reg(struct registers *reg);
+void print_reg(FILE *report, struct registers *reg);
 // print_reg() will print out the values for all registers
+void print_frame(struct config *cfg, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[], int src);
+// print_frame() will print out the table and the registers of a frame of time
 void ins_parse(const char *ins, char parsed[4][buffer_size]);
 // ins_parse() will parse a given string to four segments, such that original
 // string is substr0 + ' ' + substr1 + ',' + substr2 + ',' + substr3
 int reg_access(struct registers *reg, char *v);
 // reg_access() will return the value of given register
-void set_reg_access(struct registers *reg, char v[buffer_size]);
-// set_reg_access() will set the access state of given register so that no
-// other execution can use this busy register
-void reset_reg_access(struct registers *reg, char v[buffer_size]);
-// reset_reg_access() will reset the access state of given register so that
-// other execution can reuse this freed register
-int check_reg_access(struct registers *reg, char v[buffer_size]);
-// check_reg_access() will return the access state of given register
+void set_reg_access(struct registers *reg, int slot);
+// set_reg_access() will set the access state of the register in slot so that
+// no other execution can use this busy register
+void reset_reg_access(struct registers *reg, int slot);
+// reset_reg_access() will reset the access state of the register in slot so
+// that other execution can reuse this freed register
+int check_reg_access(struct registers *reg, int slot);
+// check_reg_access() will return the access state of the register in slot
+int reg_index(const char *v);
+// reg_index() will return the index of given register, $t0 to $t9 are 0 to 9
+// and $s0 to $s7 follow them
 int *reg_modify(struct registers *reg, char *v);
 // reg_modify() will return the pointer to the register value so that it can
 // be modified during after execution
-void calculate(struct registers *reg, char *ins);
+void calculate(struct registers *reg, const char *ins);
 // calculate() will execute the instruction and modify the destitation
 // register accordingly
-void pipeline(struct registers *reg, struct instructions *ins, int forwarding);
-// pipeline() will pipeline the instructions and process by the frame of time
+int threaded_operand(const char *v, int *imm);
+// threaded_operand() will return the slot of register v, or -1 and the value
+// of v in imm if it is an immediate
+int op_slot(const char *v);
+// op_slot() will return the slot of register v, or -1 if v is $zero or an
+// immediate, which no instruction waits for
+void op_lower(struct op *op, char parsed[4][buffer_size]);
+// op_lower() will decode the parsed instruction into op, all but the target
+// of a branch
+int threaded_lower(struct instructions *ins);
+// threaded_lower() will lower the instructions once to threaded code, where
+// the operation and the slots of operands are decoded, so that no string is
+// compared when they are executed, and return 0, or -1 if out of memory
+int threaded_run(struct instructions *ins, int *slot, int pc,
+  long long *budget);
+// threaded_run() will execute the threaded code from pc on the slots until
+// the end of the program or *budget instructions, jumping from handler to
+// handler by computed goto, or by a switch without GNU C. *budget is reduced
+// by the instructions executed, and the next pc is returned. if slot is NULL,
+// the handlers of the lowered code are bound instead
+int threaded_step(struct instructions *ins, int *slot, int pc);
+// threaded_step() will execute the instruction at pc on the slots, and return
+// 1 if it is a taken branch
+int execute(struct instructions *ins, struct registers *reg, int pc);
+// execute() will execute the instruction at pc on the registers, and return 1
+// if it is a taken branch
+void slot_load(int *slot, struct registers *reg);
+// slot_load() will copy the registers to the slots of the threaded code
+void slot_store(int *slot, struct registers *reg);
+// slot_store() will copy the slots of the threaded code to the registers
+int interpret(struct instructions *ins, struct registers *reg, int pc,
+  long long *budget);
+// interpret() will do the same as threaded_run() by parsing the text of every
+// instruction, for the benchmark
+double run_functional(struct instructions *ins, int mode, int runs,
+  struct registers *end, long long *count);
+// run_functional() will execute the program runs times from the start by the
+// text, the threaded code or the native code, and return the seconds taken.
+// the registers after the last run are in end, and the instructions executed
+// in count
+unsigned char *jit_bytes(unsigned char *p, const char *bytes, int n);
+// jit_bytes() will write n bytes of machine code at p, and return the end
+unsigned char *jit_int(unsigned char *p, int v);
+// jit_int() will write a 32-bit immediate at p, and return the end
+unsigned char *jit_slot(unsigned char *p, const char *bytes, int slot);
+// jit_slot() will write an instruction of two bytes on the slot, and return
+// the end
+int jit_compile(struct instructions *ins);
+// jit_compile() will translate every basic block of the threaded code to
+// x86-64 code in executable pages, where the slots stay in memory and the
+// blocks jump to each other on the outcomes of branches. return -1 if it is
+// not supported here, and the threaded code is used instead
+int jit_run(struct instructions *ins, int *slot, int pc, long long *budget);
+// jit_run() will do the same as threaded_run() by the native code, or by the
+// threaded code without it
+void jit_free(struct instructions *ins);
+// jit_free() will unmap the native code
+int states_load(struct states *m, const char *path);
+// states_load() will read the initial states, one in a line as the values of
+// $t0 to $t9 and $s0 to $s7, and return -1 if the file is invalid
+#ifdef simd_vector
+int simd_group(struct instructions *ins, lanes *slot, int pc,
+  long long *budget);
+// simd_group() will execute the threaded code from pc on the slots of all the
+// lanes in lockstep, until the end, *budget instructions, or a branch where
+// the lanes go different ways, which is returned as -1 - pc. with AVX2, every
+// operation is one instruction on all the lanes
+#endif
+int simd_run(struct instructions *ins, struct states *m, int first,
+  long long budget, long long executed[], int end[]);
+// simd_run() will execute the program from the states first to first +
+// simd_width - 1 in the lanes, and then every lane by itself from a branch
+// where they diverge. the states are replaced by the final ones, and 1 is
+// returned if the lanes diverged
+void print_states(struct states *m, long long executed[], int end[],
+  int groups, int diverged);
+// print_states() will print the final registers of every state
+void states_bench(struct instructions *ins, struct states *m,
+  long long budget, int runs);
+// states_bench() will time the states run one by one against in lanes
+int pipeline(struct registers reg[], struct instructions ins[],
+  struct config *cfg, struct stats *st);
+// pipeline() will pipeline the instructions and process by the frame of time.
+// reg and ins hold one register file and one program per hardware thread, and
+// all the threads share one pipeline by interleaving at fetch. 0 is returned,
+// or -1 if out of memory or the writer of the frames cannot be started
+int pipeline_source(struct config *cfg);
+// pipeline_source() will return where the outcomes of branches come from
+int pipeline_output(struct config *cfg);
+// pipeline_output() will return output_none if the run neither prints nor
+// records any cycle, output_print if it only prints them, or output_record
+int machine_begin(struct machine *m, struct registers reg[],
+  struct instructions ins[], struct config *cfg, struct stats *st, int src,
+  int out);
+// machine_begin() will set up the state of the pipeline for a run, so that
+// the pipeline keeps no state of its own and a run can stop at any frame of
+// time and go on later, and return 0, or -1 if out of memory or the writer
+// of the frames cannot be started
+void machine_end(struct machine *m, int out);
+// machine_end() will record the cycles of the run and close its outputs
+int machine_step(struct machine *m);
+// machine_step() will simulate one frame of time of a run which executes
+// the programs and records nothing, and return 1 if the run has ended, or -1
+// if out of memory, when the run goes on without fast-forward
+struct writer *writer_start(struct config *cfg, struct instructions ins[],
+  int src);
+// writer_start() will start the thread which formats and prints the frames
+// of time of a run, as they are sent by writer_frame(), or return NULL if
+// it cannot be started
+void writer_frame(struct writer *wr, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time);
+// writer_frame() will send what changed in the frame of time since the last
+// one sent, to be printed
+void writer_stop(struct writer *wr);
+// writer_stop() will wait until every frame sent is printed, and free the
+// writer
+void writer_push(struct writer *wr, int op, int a, int b, int c, int d);
+// writer_push() will put a record into the ring, and wait while it is full
+void writer_publish(struct writer *wr);
+// writer_publish() will make the records pushed visible to the writer
+void *writer_run(void *arg);
+// writer_run() will apply the records to the frame of the writer, and print
+// it when it is complete
+void table_shift(int w_table[cycle_max << 2][cycle_max + 1], int k);
+// table_shift() will slide the columns of the table by k frames of time
+void journal_frame(struct writer *wr);
+// journal_frame() will print what changed in the frame of the writer since
+// the last one: the rows which left the window or entered it, the stage of
+// every row in this frame and the registers written
+int journal_rebuild(int argc, char **argv);
+// journal_rebuild() will print the tables of a run from its journal, all of
+// them or the one of a cycle
+double run_pipeline(struct registers reg[], struct instructions ins[],
+  struct config *cfg, struct stats *st, int runs);
+// run_pipeline() will pipeline the programs runs times from the registers reg,
+// and return the seconds taken
+void run_benchmark(struct registers reg[], struct instructions ins[],
+  struct config *cfg, int runs);
+// run_benchmark() will time the pipeline on the programs, and the execution
+// of them by the text and by the threaded code, and print the speedups
+int fetch_thread(struct working *wk, int w_table[cycle_max << 2][cycle_max + 1],
+  int w_done[cycle_max << 2], int next_ins[thread_max], int last,
+  struct config *cfg, int time);
+// fetch_thread() will pick the hardware thread to fetch from in this frame
+// of time according to the fetch policy, or return -1 if no thread is ready
+void slide_window(struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int *time);
+// slide_window() will drop the instructions that are done from the front of
+// w_table when it is almost full, and the oldest frames of time when the last
+// column is reached, so that the simulation can run without a limit
+int steady_commit(struct steady *ss, int pc, int taken);
+// steady_commit() will log an instruction done in WB, and return 0, or -1 if
+// out of memory
+int steady_signature(struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int next_ins, struct registers *reg, int time, int *sig);
+// steady_signature() will write the state of the pipeline that decides its
+// future timing to sig, and return the length of it
+void steady_state(struct steady *ss, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int next_ins, struct registers *reg, struct instructions *ins,
+  struct config *cfg, struct stats *st, struct livelock *lv, int pc,
+  int time);
+// steady_state() will be called after a taken backward branch at pc. if the
+// pipeline has been in the same state at this branch, the iterations of the
+// loop that take the same way are executed without the pipeline, and the
+// cycles and statistics of them are added at once
+int livelock_check(struct livelock *lv, int pc, const int *value);
+// livelock_check() will be called after every taken backward branch at pc of
+// a thread with the slots of its registers, and return the count of taken
+// backward branches since the same branch with the same registers, or 0. the
+// execution only depends on them, so a program found in the same state again
+// never ends
+void livelock_found(struct stats *st, int tid, int pc, int period, int cycle);
+// livelock_found() will record the loop of a thread never ending
+int print_livelock(struct instructions ins[], struct config *cfg,
+  struct stats *st);
+// print_livelock() will print the loops never ending, and return 1 if any
+void print_summary(struct registers reg[], struct config *cfg,
+  struct stats *st);
+// print_summary() will print the cycles, CPI and statistics of a run and the
+// registers at the end
+int fetch_ready(struct instructions *ins, struct config *cfg, int pos);
+// fetch_ready() will return 1 if there is an instruction at pos to fetch
+int fetch_handle(struct instructions *ins, struct config *cfg, int pos);
+// fetch_handle() will return the handle of the text of the instruction at pos
+int stream_open(struct stream *s, const char *path);
+// stream_open() will open the stream of instructions, "-" for stdin, and
+// return -1 if it cannot be opened
+int stream_parse(const char *line, char *out, int *taken);
+// stream_parse() will write the instruction of a line to out, and return 1,
+// or 0 for a line without instruction, or -1 for an invalid one
+int stream_ready(struct stream *s, int pos);
+// stream_ready() will read the stream until the instruction at pos, and
+// return 0 if the stream ends before it
+void print_stream(struct stream *s, struct stats *st, int cycles);
+// print_stream() will print the CPI since the last report and overall
+void print_smt_report(struct config *cfg, struct stats *smt,
+  struct stats alone[thread_max]);
+// print_smt_report() will print per-thread CPI and pipeline utilization of
+// the multithreaded run against the single-thread run of each program
+void schedule(struct instructions *ins, struct instructions *out, int forwarding);
+// schedule() will reorder the instructions in every basic block of ins into
+// out, so that independent instructions fill the slots of data hazards. out
+// shares the text, lines, labels and string pool of ins
+void schedule_block(struct instructions *ins, struct instructions *out,
+  int start, int end, int forwarding);
+// schedule_block() will list-schedule the instructions from start to end of
+// ins into out by the dependency DAG, after the scheduled instructions that
+// fall through into the block, and a branch at the end stays at the end
+void print_schedule(struct instructions *ins, struct config *cfg);
+// print_schedule() will print the scheduled program, and the cycles and nops
+// of the original and the scheduled program
+int grid_option(struct grid *g, const char *spec);
+// grid_option() will add the values of one dimension to the grid, given as
+// "forwarding=F,N", "schedule=no,yes" or "policy=rr,icount", and return 0 on
+// success or -1 if spec is invalid
+void run_sweep(struct instructions ins[], struct config *cfg, struct grid *g);
+// run_sweep() will run the programs under every configuration of the grid
+// concurrently, and print one table of the results
+void *sweep_worker(void *arg);
+// sweep_worker() will run the configurations of a sweep until none is left,
+// every run has its own registers and pipeline state
+void profile_add(struct profile *prof, int tid, int pc, int cause, int detail,
+  long long cycles);
+// profile_add() will attribute the lost cycles to the instruction at pc of
+// thread tid for the cause
+int hotspot_compare(const void *a, const void *b);
+// hotspot_compare() will order the hot spots by the cycles lost, most first
+void print_profile(struct instructions ins[], struct config *cfg,
+  struct profile *prof, struct stats *st);
+// print_profile() will print the hot spots sorted by the cycles lost, and the
+// source annotated with the cycles lost at every line
+int series_open(struct series *s, const char *spec, const char *path);
+// series_open() will open the file of a time series sampled every spec cycles,
+// in JSON lines if the file ends with .json or .jsonl and in CSV otherwise.
+// return -1 if the period or the file is invalid
+void series_emit(struct series *s, int time);
+// series_emit() will write the change of the counters since the last sample
+int trace_open(struct trace *t, const char *format, const char *path);
+// trace_open() will open the file of a timeline in the format chrome or
+// konata. return -1 if the format or the file is invalid
+void trace_stage(struct trace *t, struct working *wk, int i, int time);
+// trace_stage() will write the end of the last stage of working instruction i
+void trace_cycle(struct trace *t, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int time);
+// trace_cycle() will write the stages begun and ended in this frame of time,
+// so that the trace grows with the simulation
+void trace_close(struct trace *t, struct working *wk, int time);
+// trace_close() will end the stages still open and close the file
+void tl_put(struct timeline *tl, int byte);
+// tl_put() will write a byte to the timeline
+void tl_varint(struct timeline *tl, unsigned long long v);
+// tl_varint() will write v in 7 bits per byte, the high bit tells more bytes
+void tl_fixed(struct timeline *tl, unsigned long long v, int bytes);
+// tl_fixed() will write v in the given bytes for the index
+void tl_entry_add(struct tl_entry **index, int *count, int *size, int pos,
+  int cycle, long long offset);
+// tl_entry_add() will record the entry at pos of the index, growing it
+void tl_snapshot(struct timeline *tl, int time);
+// tl_snapshot() will write all the registers and index them by the cycle
+int timeline_open(struct timeline *tl, const char *path);
+// timeline_open() will open the file of the binary timeline, and return -1 if
+// it cannot be opened
+void timeline_begin(struct timeline *tl, int threads);
+// timeline_begin() will write the header and the registers at cycle 0
+void timeline_cycle(struct timeline *tl, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time);
+// timeline_cycle() will write the stage transitions and the registers written
+// in this frame of time, and a snapshot every snapshot_period cycles
+void timeline_close(struct timeline *tl, int time);
+// timeline_close() will write the index and the footer and close the file
+unsigned long long zigzag(long long v);
+// zigzag() will map a signed value to an unsigned one, small near zero
+long long unzigzag(unsigned long long v);
+// unzigzag() will map the value of zigzag() back
+unsigned long long tl_get(FILE *in, int bytes);
+// tl_get() will read a value of the given bytes
+unsigned long long tl_get_varint(FILE *in);
+// tl_get_varint() will read a value written by tl_varint()
+void tl_read_entry(FILE *in, long long index, int pos, struct tl_entry *e);
+// tl_read_entry() will read the entry at pos of the index
+int timeline_query(int argc, char **argv);
+// timeline_query() will answer a query on a binary timeline: "info", "stage
+// <n> <cycle>" for the stage of instruction #n, or "regs <cycle>". only the
+// index and the records from the nearest entry are read
+int put_varint(FILE *out, unsigned long long v);
+// put_varint() will write v in 7 bits per byte, the high bit tells more
+// bytes, and return the count of bytes
+void capture(struct instructions *ins, struct replay *rp, int tid);
+// capture() will execute the program of thread tid in order without the
+// pipeline, and record every instruction and the outcome of every branch
+int replay_branch(struct replay *rp, int tid, int *cursor, int pc);
+// replay_branch() will return 1 if the branch at pc of thread tid is taken,
+// and move the cursor after it
+int replay_save(struct replay *rp, const char *path);
+// replay_save() will write the captured trace, and return -1 on failure
+int replay_load(struct replay *rp, const char *path);
+// replay_load() will read a captured trace, and return -1 on failure
+void replay_free(struct replay *rp);
+// replay_free() will free the records of a trace
+int result_key(struct instructions ins[], struct config *cfg,
+  unsigned long long *key);
+// result_key() will hash the programs as lexed, without comments and spaces,
+// the options of the run and the executable of the simulator into key, and
+// return -1 if the executable cannot be read
+int result_load(struct results *rs, struct registers reg[],
+  struct instructions ins[], struct config *cfg);
+// result_load() will print the cached result of the run and return its exit
+// status, or return -1 if it is not in the cache
+int result_begin(struct results *rs, struct config *cfg);
+// result_begin() will start to write the result of the run, and send the
+// output of the run there if it cannot be rebuilt. return -1 on failure
+void result_end(struct results *rs, struct registers reg[],
+  struct config *cfg, struct stats *st, int status);
+// result_end() will finish the result and move it into the cache, print the
+// output kept in it, and evict the least recently used results beyond the
+// bound of the cache
+void result_evict(struct results *rs);
+// result_evict() will remove the results used least recently until the rest
+// fit in the bound
+int result_compare(const void *a, const void *b);
+// result_compare() will order the results by the time of use, oldest first
+int run_daemon(const char *path);
+// run_daemon() will listen on the Unix domain socket at path, poll the idle
+// connections and hand the requests to one worker per core, and only return
+// on failure
+void *daemon_worker(void *arg);
+// daemon_worker() will serve one request after another, of any connection
+int daemon_job(struct daemon *d, struct client *c);
+// daemon_job() will read one request of the client, run it and write the
+// response, and return -1 if the connection is to be closed
+int daemon_line(struct client *c, char *line);
+// daemon_line() will read a line of at most buffer_size - 1 bytes without
+// "\n" to line, and return -1 if the connection ends or the line is too long
+int daemon_read(struct client *c, char *buffer, long size);
+// daemon_read() will read size bytes, and return -1 if the connection ends
+int daemon_write(int fd, const char *buffer, size_t size);
+// daemon_write() will write size bytes, and return -1 on failure
+int daemon_error(int fd, const char *error);
+// daemon_error() will write the response of a request which fails with the
+// line error, and return -1 on failure
+struct cached *daemon_program(struct daemon *d, const char *text, long size,
+  FILE *report);
+// daemon_program() will return the decoded program of the text from the
+// cache, or decode and cache it, with one more job on it. if it cannot be
+// decoded, the error is printed to report and NULL is returned
+void daemon_release(struct daemon *d, struct cached *c);
+// daemon_release() will end a job on a program, and free it if it is no
+// longer cached
+int run_watch(const char *path, struct instructions *ins, struct config *cfg);
+// run_watch() will run the program loaded from path, then run it again
+// whenever the file changes, from the latest checkpoint before the change
+// can make a difference, and print only the frames of time that differ. only
+// returns on failure
+int watch_simulate(struct watch *w, int from);
+// watch_simulate() will simulate from the checkpoint from, or from the start
+// if it is -1, to the end, keep checkpoints, and print the frames which differ
+// from the last run. 0 is returned, or -1 if the writer of the frames cannot
+// be started
+unsigned long long watch_frame(struct watch *w);
+// watch_frame() will hash what is printed of the current frame of time
+int watch_change(struct instructions *old, struct instructions *ins);
+// watch_change() will return the first position where the instructions or
+// the targets of the branches differ, or -1 if none does
+int watch_same(const struct stat *a, const struct stat *b);
+// watch_same() will return 1 if a and b are the same version of a file
+int golden_open(struct golden *g, const char *path);
+// golden_open() will open the file to record the golden hashes of a run, and
+// return -1 if it cannot be opened
+void golden_cycle(struct golden *g, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time);
+// golden_cycle() will roll the stages of the rows and the registers of this
+// frame of time into the hashes, and record them or compare them with the
+// golden ones, keeping the state of the first cycle which differs
+int golden_save(struct golden *g, struct config *cfg, struct registers reg[],
+  const char *path[]);
+// golden_save() will write the options, the names of the programs, the hashes
+// of every cycle and the final registers, and close the file. return -1 on
+// failure
+int run_golden(const char *dir);
+// run_golden() will run every golden run in dir again on one worker per core,
+// and print whether each is the same, or its first cycle which differs
+void *golden_worker(void *arg);
+// golden_worker() will check the golden runs until none is left
+void golden_check(const char *dir, struct golden_job *job);
+// golden_check() will load the golden run and its programs, run them with
+// the options recorded, and print the result to the report of the job
+int golden_compare(const void *a, const void *b);
+// golden_compare() will order the golden runs by their names
 
 
+#ifndef p1_library                      // the library has no main
 int main(int argc, char **argv) {
   // variable declaration
-  struct registers reg;
-  struct instructions ins;
-  int forwarding;
+  struct registers reg[thread_max];
+  struct instructions ins[thread_max];
+  struct config cfg;
+  struct stats st;
+  struct grid g;
+  struct profile prof;
+  struct series series;
+  struct trace trace;
+  struct timeline timeline;
+  struct replay rp;
+  struct stream stream;
+  const char *capture_path = NULL;
+  int bench_runs = 0;
+  long long func_budget = -1;           // instructions of -f, or -1 for none
+  const char *states_path = NULL;
+  struct results rs;
+  const char *last_path = NULL;         // file of the last program
+  const char *program_path[thread_max]; // file of every program
+  struct golden golden;
+  int watch = 0;
+  int sweep = 0;
+  int i;
+
+  // query a binary timeline instead of simulating
+  if (argc >= 2 && strcmp(argv[1], "-q") == 0)
+    return timeline_query(argc - 2, argv + 2);
+  // rebuild the tables of a journal instead of simulating
+  if (argc >= 2 && strcmp(argv[1], "-y") == 0)
+    return journal_rebuild(argc - 2, argv + 2);
+  // serve the jobs sent to the socket
+  if (argc == 3 && strcmp(argv[1], "-d") == 0)
+    return run_daemon(argv[2]);
+  // check the golden runs of a directory
+  if (argc == 3 && strcmp(argv[1], "-v") == 0)
+    return run_golden(argv[2]);
 
   // arguments validity check
-  if (argc != 3) {
+  if (argc < 3) {
     fprintf(stderr, "ERROR: incorrect number of inputs.\n");
     return EXIT_FAILURE;
   } else if (argv[1][0] != 'F' && argv[1][0] != 'N') {
     fprintf(stderr, "ERROR: invalid forwarding setting.\n");
     return EXIT_FAILURE;
   }
-  forwarding = argv[1][0] == 'F'? 1: 0;
+  cfg.forwarding = argv[1][0] == 'F'? 1: 0;
+  cfg.threads = 0;
+  cfg.policy = policy_rr;
+  cfg.verbose = 1;
+  cfg.schedule = 0;
+  cfg.prof = NULL;
+  cfg.series = NULL;
+  cfg.trace = NULL;
+  cfg.timeline = NULL;
+  cfg.replay = NULL;
+  cfg.stream = NULL;
+  cfg.golden = NULL;
+  cfg.limit = cycle_max;
+  cfg.summary = 0;
+  cfg.journal = 0;
+  cfg.report = stdout;
+  memset(&g, 0, sizeof(g));
+  memset(&prof, 0, sizeof(prof));
+  memset(&rs, 0, sizeof(rs));
 
-  // initialize the data
-  data_init(&reg, &ins);
+  // every file is the program of one hardware thread, and the options can be
+  // given among them, e.g. "F a.s b.s -p icount"
+  for (i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "-s") == 0)
+      cfg.schedule = 1;
+    else if (strcmp(argv[i], "-a") == 0) {
+      cfg.prof = &prof;                 // attribute the stalls and only
+      cfg.verbose = 0;                  // print the profile
+    }
+    else if (strcmp(argv[i], "-t") == 0 && i + 2 < argc) {
+      if (cfg.series || series_open(&series, argv[i + 1], argv[i + 2])) {
+        fprintf(stderr, "ERROR: invalid time series %s %s.\n", argv[i + 1],
+          argv[i + 2]);
+        return EXIT_FAILURE;
+      }
+      cfg.series = &series;             // sample the counters and only
+      cfg.verbose = 0;                  // write the time series
+      i += 2;
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 2 < argc) {
+      if (cfg.trace || trace_open(&trace, argv[i + 1], argv[i + 2])) {
+        fprintf(stderr, "ERROR: invalid trace %s %s.\n", argv[i + 1],
+          argv[i + 2]);
+        return EXIT_FAILURE;
+      }
+      cfg.trace = &trace;               // write the timeline instead of
+      cfg.verbose = 0;                  // the table
+      i += 2;
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      if (cfg.timeline || timeline_open(&timeline, argv[++i])) {
+        fprintf(stderr, "ERROR: invalid timeline %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      cfg.timeline = &timeline;         // record the history instead of
+      cfg.verbose = 0;                  // printing the table
+    }
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+      if (cfg.golden || golden_open(&golden, argv[++i])) {
+        fprintf(stderr, "ERROR: invalid golden run %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      cfg.golden = &golden;             // record the hashes of every cycle
+      cfg.verbose = 0;                  // instead of printing the table
+    }
+    else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      if (cfg.stream || stream_open(&stream, argv[++i])) {
+        fprintf(stderr, "ERROR: invalid stream %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      cfg.stream = &stream;             // time the instructions as they come
+      cfg.verbose = 0;                  // in, without a limit of cycles
+      cfg.limit = 0;
+    }
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      char *end;
+      long limit = strtol(argv[++i], &end, 10);
+      if (*argv[i] == '\0' || *end != '\0' || limit < 0 || limit > 0x7fffffff) {
+        fprintf(stderr, "ERROR: invalid limit of cycles %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      cfg.limit = (int)limit;
+    }
+    else if (strcmp(argv[i], "-n") == 0) {
+      cfg.summary = 1;                  // print only the summary
+      cfg.verbose = 0;
+    }
+    else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      bench_runs = atoi(argv[++i]);
+      if (bench_runs <= 0) {
+        fprintf(stderr, "ERROR: invalid count of runs %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      char *end;
+      func_budget = strtoll(argv[++i], &end, 10);
+      if (*argv[i] == '\0' || *end != '\0' || func_budget < 0) {
+        fprintf(stderr, "ERROR: invalid count of instructions %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    }
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+      states_path = argv[++i];
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      capture_path = argv[++i];
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      if (cfg.replay || replay_load(&rp, argv[++i])) {
+        fprintf(stderr, "ERROR: invalid trace %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      cfg.replay = &rp;                 // time the trace without executing
+    }
+    else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+      if (grid_option(&g, argv[++i])) {
+        fprintf(stderr, "ERROR: invalid sweep %s.\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+      sweep = 1;
+    }
+    else if (strcmp(argv[i], "-z") == 0 && i + 2 < argc) {
+      char *end;
+      long long bound = strtoll(argv[i + 1], &end, 10);
+      if (*argv[i + 1] == '\0' || *end != '\0' || bound <= 0
+        || bound > LLONG_MAX >> 20) {
+        fprintf(stderr, "ERROR: invalid cache %s %s.\n", argv[i + 1],
+          argv[i + 2]);
+        return EXIT_FAILURE;
+      }
+      rs.bound = bound << 20;           // in megabytes
+      rs.dir = argv[i + 2];
+      i += 2;
+    }
+    else if (strcmp(argv[i], "-u") == 0)
+      rs.update = 1;                    // run again and replace the result
+    else if (strcmp(argv[i], "-w") == 0)
+      watch = 1;                        // run again on every edit
+    else if (strcmp(argv[i], "-j") == 0)
+      cfg.journal = 1;                  // only the changes of the tables
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      ++i;
+      if (strcmp(argv[i], "rr") == 0)
+        cfg.policy = policy_rr;
+      else if (strcmp(argv[i], "icount") == 0)
+        cfg.policy = policy_icount;
+      else {
+        fprintf(stderr, "ERROR: invalid fetch policy.\n");
+        return EXIT_FAILURE;
+      }
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "ERROR: invalid option %s.\n", argv[i]);
+      return EXIT_FAILURE;
+    } else if (cfg.threads == thread_max) {
+      fprintf(stderr, "ERROR: at most %d programs are supported.\n", thread_max);
+      return EXIT_FAILURE;
+    } else {
+      // initialize the data
+      data_init(&reg[cfg.threads], &ins[cfg.threads]);
+      // read the file
+      int err = load_program(argv[i], &ins[cfg.threads]);
+      if (err == -1) {
+        fprintf(stderr, "ERROR: cannot open file.\n");
+        return EXIT_FAILURE;
+      } else if (err > 0) {
+        fprintf(stderr, "ERROR: invalid instruction at line %d.\n", err);
+        return EXIT_FAILURE;
+      }
+      // preprocess the labels
+      if (err == 0)
+        err = label_preprocess(&ins[cfg.threads]);
+      // a taken branch to no label would stop the pipeline
+      if (err == 0 && (err = label_check(&ins[cfg.threads])) > 0) {
+        fprintf(stderr, "ERROR: undefined label at line %d.\n", err);
+        return EXIT_FAILURE;
+      }
+      // lower the instructions to threaded code
+      if (err == 0)
+        err = threaded_lower(&ins[cfg.threads]);
+      if (err) {
+        fprintf(stderr, "ERROR: out of memory.\n");
+        return EXIT_FAILURE;
+      }
+      last_path = argv[i];
+      program_path[cfg.threads] = argv[i];
+      ++cfg.threads;
+    }
+  }
+  if (cfg.stream) {
+    // the stream is the only program, and is not known up front
+    if (cfg.threads || cfg.schedule || sweep || capture_path || cfg.replay
+      || cfg.prof || bench_runs || func_budget >= 0 || states_path || watch
+      || cfg.golden) {
+      fprintf(stderr, "ERROR: a stream cannot be used with other programs.\n");
+      return EXIT_FAILURE;
+    }
+    data_init(&reg[0], &ins[0]);
+    ins[0].pool = stream.pool;
+    cfg.threads = 1;
+    if (pipeline(reg, ins, &cfg, &st)) {
+      fprintf(stderr, "ERROR: out of memory.\n");
+      return EXIT_FAILURE;
+    }
+    print_stream(&stream, &st, st.cycles);
+    if (cfg.series)
+      fclose(series.out);
+    if (stream.in != stdin)
+      fclose(stream.in);
+    return stream.error? EXIT_FAILURE: EXIT_SUCCESS;
+  }
+  if (cfg.threads == 0) {
+    fprintf(stderr, "ERROR: incorrect number of inputs.\n");
+    return EXIT_FAILURE;
+  }
+  // a journal has every frame of the tables, in the order of time
+  if (cfg.journal && (!cfg.verbose || watch)) {
+    fprintf(stderr, "ERROR: a journal needs the tables of every frame.\n");
+    return EXIT_FAILURE;
+  }
 
-  // read the file
-  char buffer[buffer_size];
-  FILE *ins_file = fopen(argv[2], "r");
-  if (ins_file == NULL) {
-    fprintf(stderr, "ERROR: cannot open file.\n");
+  // only one program is watched, and its frames are printed by the watch
+  if (watch) {
+    if (cfg.threads != 1 || cfg.schedule || sweep || capture_path
+      || cfg.replay || cfg.prof || cfg.series || cfg.trace || cfg.timeline
+      || cfg.golden || bench_runs || func_budget >= 0 || states_path || rs.dir) {
+      fprintf(stderr, "ERROR: only one program can be watched, alone.\n");
+      return EXIT_FAILURE;
+    }
+    return run_watch(last_path, &ins[0], &cfg);
+  }
+
+  if (cfg.replay && cfg.replay->threads != cfg.threads) {
+    fprintf(stderr, "ERROR: the trace has %d threads.\n", cfg.replay->threads);
     return EXIT_FAILURE;
   }
-  while (fgets(buffer, buffer_size, ins_file)) {
-    // be compatible with:
-    //    windows style newline character, "\r\n";
-    //    linux style newline character, "\n";
-    //    and no newline character at the EOF.
-    if (buffer[strlen(buffer) - 1] == 10)   // '\n' has ASCII code of 10
-      buffer[strlen(buffer) - 1] = '\0';    // strip of the last '\n'
-    if (buffer[strlen(buffer) - 1] == 13)   // '\r' has ASCII code of 13
-      buffer[strlen(buffer) - 1] = '\0';    // strip of the last '\r'
-    strcpy(ins.o_ins[ins.o_count++], buffer);
+  // the branches past the end of a cut trace have no outcome
+  for (i = 0; cfg.replay && i < cfg.threads; ++i)
+    if (!cfg.replay->complete[i]) {
+      fprintf(stderr, "ERROR: the trace of thread %d is cut.\n", i);
+      return EXIT_FAILURE;
+    }
+
+  // only execute the programs and capture the trace
+  if (capture_path) {
+    memset(&rp, 0, sizeof(rp));
+    rp.threads = cfg.threads;
+    for (i = 0; i < cfg.threads; ++i) {
+      capture(&ins[i], &rp, i);
+      printf("thread %d: %d instructions captured%s\n", i, rp.count[i],
+        rp.complete[i]? "": ", the program is cut");
+    }
+    if (replay_save(&rp, capture_path)) {
+      fprintf(stderr, "ERROR: cannot write file.\n");
+      return EXIT_FAILURE;
+    }
+    replay_free(&rp);
+    for (i = 0; i < cfg.threads; ++i)
+      program_free(&ins[i]);
+    return EXIT_SUCCESS;
+  }
+
+  // only execute the program from every initial state, in lockstep
+  if (states_path) {
+    struct states m;
+    long long budget = func_budget > 0? func_budget: LLONG_MAX;
+    int diverged = 0;
+    if (cfg.threads != 1 || states_load(&m, states_path)) {
+      fprintf(stderr, "ERROR: invalid states %s for one program.\n",
+        states_path);
+      return EXIT_FAILURE;
+    }
+    jit_compile(&ins[0]);               // for the lanes that diverge
+    if (bench_runs)
+      states_bench(&ins[0], &m, budget, bench_runs);
+    else {
+      long long *executed = malloc(sizeof(long long) * m.count);
+      int *end = malloc(sizeof(int) * m.count);
+      assert(executed != NULL && end != NULL);
+      for (i = 0; i < m.count; i += simd_width)
+        diverged += simd_run(&ins[0], &m, i, budget, executed, end);
+      print_states(&m, executed, end, (m.count + simd_width - 1) / simd_width,
+        diverged);
+      free(executed);
+      free(end);
+    }
+    free(m.value);
+    program_free(&ins[0]);
+    return EXIT_SUCCESS;
+  }
+
+  // only execute the programs without the pipeline, by the native code
+  if (func_budget >= 0) {
+    for (i = 0; i < cfg.threads; ++i) {
+      int slot[slot_count];
+      long long budget = func_budget? func_budget: LLONG_MAX;
+      jit_compile(&ins[i]);
+      slot_load(slot, &reg[i]);
+      int pc = jit_run(&ins[i], slot, 0, &budget);
+      slot_store(slot, &reg[i]);
+      printf("thread %d: %lld instructions executed%s\n", i,
+        (func_budget? func_budget: LLONG_MAX) - budget,
+        pc < ins[i].le_count? ", the program is cut": "");
+      print_reg(stdout, &reg[i]);
+      program_free(&ins[i]);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // only time the pipeline, nothing is printed or recorded
+  if (bench_runs) {
+    cfg.verbose = 0;
+    cfg.prof = NULL;
+    cfg.series = NULL;
+    cfg.trace = NULL;
+    cfg.timeline = NULL;
+    cfg.golden = NULL;
+    run_benchmark(reg, ins, &cfg, bench_runs);
+    if (cfg.replay)
+      replay_free(cfg.replay);
+    for (i = 0; i < cfg.threads; ++i)
+      program_free(&ins[i]);
+    return EXIT_SUCCESS;
+  }
+
+  // run a grid of configurations on the programs loaded once
+  if (sweep) {
+    run_sweep(ins, &cfg, &g);
+    for (i = 0; i < cfg.threads; ++i)
+      program_free(&ins[i]);
+    return EXIT_SUCCESS;
   }
-  fclose(ins_file);
 
-  // preprocess the labels
-  label_preprocess(&ins);
+  // only schedule the programs statically and compare them
+  if (cfg.schedule) {
+    for (i = 0; i < cfg.threads; ++i) {
+      print_schedule(&ins[i], &cfg);
+      program_free(&ins[i]);
+    }
+    return EXIT_SUCCESS;
+  }
 
+  // only the runs which print their result are cached, and a run done
+  // before is printed from the cache
+  if (rs.dir && (cfg.prof || cfg.series || cfg.trace || cfg.timeline
+    || cfg.golden || cfg.replay || result_key(ins, &cfg, &rs.key)))
+    rs.dir = NULL;
+  if (rs.dir && !rs.update) {
+    int status = result_load(&rs, reg, ins, &cfg);
+    if (status >= 0) {
+      for (i = 0; i < cfg.threads; ++i)
+        program_free(&ins[i]);
+      return status;
+    }
+  }
+  if (rs.dir && result_begin(&rs, &cfg))
+    rs.dir = NULL;
   // pipeline
-  pipeline(&reg, &ins, forwarding);
+  if (pipeline(reg, ins, &cfg, &st)) {
+    fprintf(stderr, "ERROR: out of memory or threads.\n");
+    return EXIT_FAILURE;
+  }
+  if (cfg.summary)
+    print_summary(reg, &cfg, &st);
+  int status = print_livelock(ins, &cfg, &st)? livelock_status: EXIT_SUCCESS;
+  if (cfg.golden && golden_save(&golden, &cfg, reg, program_path)) {
+    fprintf(stderr, "ERROR: cannot write file.\n");
+    status = EXIT_FAILURE;
+  }
+  if (cfg.prof) {
+    print_profile(ins, &cfg, cfg.prof, &st);
+    free(prof.entry);
+  }
+  if (cfg.series)
+    fclose(series.out);
 
-  return EXIT_SUCCESS;
+  // compare the multithreaded run with every program running alone
+  if (cfg.threads > 1) {
+    struct stats alone[thread_max];
+    struct config single = cfg;
+    single.threads = 1;
+    single.verbose = 0;
+    single.prof = NULL;
+    single.series = NULL;
+    single.trace = NULL;
+    single.timeline = NULL;
+    single.golden = NULL;
+    single.replay = NULL;
+    for (i = 0; i < cfg.threads; ++i) {
+      struct registers r;
+      data_init(&r, NULL);
+      if (pipeline(&r, &ins[i], &single, &alone[i])) {
+        fprintf(stderr, "ERROR: out of memory.\n");
+        return EXIT_FAILURE;
+      }
+    }
+    print_smt_report(&cfg, &st, alone);
+  }
+  if (rs.dir)
+    result_end(&rs, reg, &cfg, &st, status);
+
+  if (cfg.replay)
+    replay_free(cfg.replay);
+  for (i = 0; i < cfg.threads; ++i)
+    program_free(&ins[i]);
+  return status;
+}
+#endif
+
+int load_program(const char *path, struct instructions *ins) {
+  struct stat sb;
+  int err;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  // the tokens are offsets of int into the text
+  if (fstat(fd, &sb) < 0 || sb.st_size > 0x7fffffff) {
+    close(fd);
+    return -1;
+  }
+  ins->size = sb.st_size;
+  ins->text = NULL;
+  if (ins->size > 0) {                  // an empty file cannot be mapped
+    void *text = mmap(NULL, ins->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(text, ins->size, MADV_SEQUENTIAL);
+    ins->text = text;
+  }
+  close(fd);
+  err = ins_lex(ins);
+  return err == -1? -2: err;            // out of memory, not unopened
+}
+
+int load_text(const char *text, long size, struct instructions *ins) {
+  ins->size = size;
+  ins->text = NULL;
+  if (size > 0) {                       // unmapped as the text of a file
+    void *copy = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED)
+      return -1;
+    memcpy(copy, text, size);
+    ins->text = copy;
+  }
+  return ins_lex(ins);
 }
 
 void data_init(struct registers *reg, struct instructions *ins) {
-  int i, j;
+  int i;
   for (i = 0; i < t_max; ++i) {
     reg->t[i] = 0;
     reg->t_access[i] = 0;
@@ -141,94 +1615,609 @@ void data_init(struct registers *reg, struct instructions *ins) {
     reg->s_access[i] = 0;
     snprintf(reg->s_name[i], buffer_size, "$s%d", i);
   }
-  for (i = 0; i < instruction_max; ++i) {
-    for (j = 0; j < buffer_size; ++j) {
-      ins->o_ins[i][j] = 0;
-      ins->le_ins[i][j] = 0;
-      ins->w_ins[i][j] = 0;
-      ins->l[i][j] = 0;
-    }
-    ins->l_pos[i] = -1;
-  }
+  if (ins == NULL)
+    return;
+  ins->text = NULL;
+  ins->size = 0;
+  ins->o_ins = NULL;
+  ins->le_ins = NULL;
+  ins->l = NULL;
+  ins->l_pos = NULL;
+  ins->target = NULL;
+  ins->pool = NULL;
+  ins->pool_size = 0;
+  ins->le_text = NULL;
+  ins->op = NULL;
+  ins->jit = NULL;
+  ins->jit_size = 0;
+  ins->jit_entry = NULL;
   ins->le_count = 0;
   ins->l_count = 0;
   ins->o_count = 0;
-  ins->w_count = 0;
 }
 
-void label_preprocess(struct instructions *ins) {
-  int i;
-  for (i = 0; i < ins->o_count; ++i) {
-    if (ins->o_ins[i][strlen(ins->o_ins[i]) - 1] == ':') {
-      ins->l_pos[ins->l_count] = ins->le_count;
-      strcpy(ins->l[ins->l_count], ins->o_ins[i]);
-      ins->l[ins->l_count][strlen(ins->l[ins->l_count]) - 1] = '\0';
-      ++ins->l_count;
+int ins_lex(struct instructions *ins) {
+  // variable declaration
+  int i, k, n;
+  int size = (int)ins->size;
+  struct chunk c[chunk_max];
+  int error = 0;
+
+  // split the text at line boundaries into one chunk per core
+  n = chunk_count(ins->size);
+  for (i = 0, k = 0; k < n && i < size; ++k) {
+    int end = k == n - 1? size: (int)((long long)size * (k + 1) / n);
+    const char *nl;
+    if (end < i)
+      end = i;
+    nl = end < size? memchr(ins->text + end, '\n', size - end): NULL;
+    end = nl == NULL? size: (int)(nl - ins->text) + 1;
+    memset(&c[k], 0, sizeof(c[k]));
+    c[k].ins = ins;
+    c[k].begin = i;
+    c[k].end = end;
+    i = end;
+  }
+  n = k;
+
+  // lex the chunks in parallel, then give every chunk the base of its lines
+  run_chunks(c, n, lex_chunk);
+  ins->o_count = 0;
+  for (k = 0, i = 0; k < n; ++k) {
+    if (c[k].nomem)
+      error = -1;
+    if (c[k].error && !error)
+      error = c[k].error + i;
+    c[k].o_base = ins->o_count;
+    ins->o_count += c[k].o_count;
+    c[k].number = i;                    // lines in the previous chunks
+    i += c[k].newlines;
+  }
+  if (error || ins->o_count == 0) {
+    for (k = 0; k < n; ++k)
+      free(c[k].o_ins);
+    return error;
+  }
+  ins->o_ins = malloc(sizeof(struct line) * ins->o_count);
+  if (ins->o_ins == NULL) {
+    for (k = 0; k < n; ++k)
+      free(c[k].o_ins);
+    return -1;
+  }
+  run_chunks(c, n, merge_chunk);
+  return 0;
+}
+
+void *lex_chunk(void *arg) {
+  struct chunk *c = arg;
+  const char *text = c->ins->text;
+  int end = c->end;
+  int capacity = 0;                     // capacity of o_ins
+  int number = 1;                       // line number in the chunk
+  int count = 0;                        // count of tokens in current line
+  int i = c->begin;
+  struct line cur;
+  while (i <= end) {
+    char c0 = i < end? text[i]: '\n';   // no newline character at the EOF
+    if (c0 == ' ' || c0 == '\t' || c0 == '\r' || c0 == ',') {
+      ++i;                              // skip the separators
+    } else if (c0 == '#') {
+      while (i < end && text[i] != '\n')
+        ++i;                            // skip the comment
+    } else if (c0 == '\n' || c0 == ':') {
+      // end of a line, or end of a label which can be followed by an
+      // instruction in the same line
+      cur.label = c0 == ':';
+      if ((cur.label && count != 1) || (!cur.label && count != 0 && count != 4)) {
+        c->error = number;              // only op rd,rs,rt is supported
+        return NULL;
+      }
+      if (!cur.label && count == 4) {
+        const char *t[4];
+        int len[4], k;
+        for (k = 0; k < 4; ++k) {
+          t[k] = text + cur.t[k].off;
+          len[k] = cur.t[k].len;
+        }
+        if (!ins_valid(t, len)) {
+          c->error = number;
+          return NULL;
+        }
+      }
+      if (count > 0) {
+        if (c->o_count == capacity) {
+          struct line *o_ins;
+          capacity = capacity? capacity << 1: 256;
+          o_ins = realloc(c->o_ins, sizeof(struct line) * capacity);
+          if (o_ins == NULL) {          // the lines so far are freed by
+            c->nomem = 1;               // ins_lex()
+            return NULL;
+          }
+          c->o_ins = o_ins;
+        }
+        cur.number = number;
+        c->o_ins[c->o_count++] = cur;
+      }
+      if (c0 == '\n' && i < end)
+        ++number;
+      count = 0;
+      ++i;
     } else {
-      strcpy(ins->le_ins[ins->le_count], ins->o_ins[i]);
-      ++ins->le_count;
+      int start = i;
+      while (i < end && text[i] != ' ' && text[i] != '\t' && text[i] != '\r'
+        && text[i] != ',' && text[i] != '\n' && text[i] != '#'
+        && text[i] != ':')
+        ++i;
+      if (count == 4 || i - start >= buffer_size) {
+        c->error = number;
+        return NULL;
+      }
+      cur.t[count].off = start;
+      cur.t[count].len = i - start;
+      ++count;
     }
   }
-  assert(ins->l_count + ins->le_count == ins->o_count);
+  c->newlines = number - 1;
+  return NULL;
+}
+
+void *merge_chunk(void *arg) {
+  struct chunk *c = arg;
+  int i;
+  struct line *o_ins = c->ins->o_ins + c->o_base;
+  for (i = 0; i < c->o_count; ++i) {
+    o_ins[i] = c->o_ins[i];
+    o_ins[i].number += c->number;
+  }
+  free(c->o_ins);
+  c->o_ins = NULL;
+  return NULL;
+}
+
+int op_base(const char *op, int len) {
+  // the form with an immediate is only another name, both forms take a
+  // register or an immediate as any source operand
+  static const char *const name[] = {
+    "add", "addi", "and", "andi", "or", "ori", "slt", "slti", "beq", "bne"
+  };
+  static const int base[] = {
+    op_add, op_add, op_and, op_and, op_or, op_or, op_slt, op_slt, op_beq,
+    op_bne
+  };
+  int i;
+  for (i = 0; i < (int)(sizeof(base) / sizeof(base[0])); ++i)
+    if ((int)strlen(name[i]) == len && strncmp(op, name[i], len) == 0)
+      return base[i];
+  return -1;
+}
+
+int operand_kind(const char *v, int len) {
+  int i;
+  long long value = 0;
+  if (len == 5 && strncmp(v, "$zero", 5) == 0)
+    return operand_zero;
+  if (v[0] == '$')
+    return len == 3 && ((v[1] == 't' && v[2] >= '0' && v[2] < '0' + t_max)
+      || (v[1] == 's' && v[2] >= '0' && v[2] < '0' + s_max))?
+      operand_register: -1;
+  // an immediate has to fit in an int
+  i = v[0] == '-' || v[0] == '+'? 1: 0;
+  if (i == len)
+    return -1;
+  for (; i < len; ++i) {
+    if (!isdigit((unsigned char)v[i]))
+      return -1;
+    value = value * 10 + (v[i] - '0');
+    if (value > (long long)INT_MAX + (v[0] == '-'))
+      return -1;
+  }
+  return operand_immediate;
+}
+
+int ins_valid(const char *const t[4], const int len[4]) {
+  int base = op_base(t[0], len[0]);
+  int rs = operand_kind(t[2], len[2]);
+  if (base == -1 || rs == -1)
+    return 0;
+  // a branch compares its first two operands, and the label is checked once
+  // the labels are known. only a register can be written
+  if (base == op_beq || base == op_bne)
+    return operand_kind(t[1], len[1]) != -1;
+  return operand_kind(t[1], len[1]) == operand_register
+    && operand_kind(t[3], len[3]) != -1;
+}
+
+int label_check(struct instructions *ins) {
+  int i;
+  for (i = 0; i < ins->le_count; ++i) {
+    struct line *ln = &ins->o_ins[ins->le_ins[i]];
+    if (ins->target[i] == -1 && ins->text[ln->t[0].off] == 'b')
+      return ln->number;
+  }
+  return 0;
 }
 
-void print_table(struct instructions *ins, int w_table[cycle_max << 2][cycle_max + 1]) {
+int label_preprocess(struct instructions *ins) {
   // variable declaration
-  int i, j;
-  char symbol[7][4];                    // symbol store int-string conversion
+  int i, k, n;
+  int le_count, l_count;
+  int h_size;                           // size of the hash table of labels
+  int *h_label;                         // label in each slot, or -1
+  struct chunk c[chunk_max];
+  int size = ins->o_count > 0? ins->o_count: 1;
 
-  // initialize the data
-  strcpy(symbol[0], ".");
-  strcpy(symbol[1], "IF");
-  strcpy(symbol[2], "ID");
-  strcpy(symbol[3], "EX");
-  strcpy(symbol[4], "MEM");
-  strcpy(symbol[5], "WB");
-  strcpy(symbol[6], "*");
+  ins->le_ins = malloc(sizeof(int) * size);
+  ins->l = malloc(sizeof(int) * size);
+  ins->l_pos = malloc(sizeof(int) * size);
+  ins->target = malloc(sizeof(int) * size);
+  ins->le_text = malloc(sizeof(int) * size);
+  if (ins->le_ins == NULL || ins->l == NULL || ins->l_pos == NULL
+    || ins->target == NULL || ins->le_text == NULL)
+    return -1;                          // freed by program_free()
 
-  // print the first row
-  printf("CPU Cycles ===>     ");
-  for (i = 1; i < cycle_max; ++i)
-    printf("%-4d", i);
-  printf("%d\n", cycle_max);
+  // split the lines into chunks, count the labels of every chunk, and then
+  // record the labels and instructions of all chunks in parallel
+  n = chunk_count(ins->size);
+  if (n > ins->o_count)
+    n = ins->o_count > 0? ins->o_count: 1;
+  for (k = 0; k < n; ++k) {
+    memset(&c[k], 0, sizeof(c[k]));
+    c[k].ins = ins;
+    c[k].begin = (int)((long long)ins->o_count * k / n);
+    c[k].end = (int)((long long)ins->o_count * (k + 1) / n);
+  }
+  run_chunks(c, n, count_chunk);
+  for (k = 0, le_count = 0, l_count = 0; k < n; ++k) {
+    c[k].le_base = le_count;
+    c[k].l_base = l_count;
+    le_count += c[k].le_count;
+    l_count += c[k].l_count;
+  }
+  run_chunks(c, n, label_chunk);
+  ins->le_count = le_count;
+  ins->l_count = l_count;
+  assert(ins->l_count + ins->le_count == ins->o_count);
 
-  // print the rest of the table
-  for (i = 0; i < ins->w_count; ++i) {
-    printf("%-20s", ins->w_ins[i]);
-    for (j = 1; j < cycle_max; ++j) {
-      if (w_table[i][j] >= 7) {
-        fprintf(stderr, "w_count = %d\n", ins->w_count);
-        fprintf(stderr, "ERROR: w_table[%d][%d] = %d\n", i, j, w_table[i][j]);
-      }
-      assert(w_table[i][j] >= 0);
-      assert(w_table[i][j] < 7);
-      printf("%-4s", symbol[w_table[i][j]]);
-    }
-    printf("%s\n", symbol[w_table[i][cycle_max]]);
+  // merge the labels of all chunks into one hash table, so that the target of
+  // every branch can be found in constant time. the first one of duplicate
+  // labels is used
+  for (h_size = 16; h_size < ins->l_count << 1; h_size <<= 1)
+    ;
+  h_label = malloc(sizeof(int) * h_size);
+  if (h_label == NULL)
+    return -1;
+  for (i = 0; i < h_size; ++i)
+    h_label[i] = -1;
+  for (i = 0; i < ins->l_count; ++i) {
+    int j = label_find(ins, h_label, h_size, &ins->o_ins[ins->l[i]].t[0]);
+    if (h_label[j] == -1)
+      h_label[j] = i;
+  }
+
+  // fix up the targets of the branches in parallel
+  for (k = 0; k < n; ++k) {
+    c[k].begin = (int)((long long)ins->le_count * k / n);
+    c[k].end = (int)((long long)ins->le_count * (k + 1) / n);
+    c[k].h_label = h_label;
+    c[k].h_size = h_size;
   }
+  run_chunks(c, n, target_chunk);
+  free(h_label);
+
+  // intern the text of the instructions into one string pool, every chunk
+  // has its own pool, which are then put together
+  run_chunks(c, n, intern_chunk);
+  ins->pool_size = 0;
+  for (k = 0, i = 0; k < n; ++k) {
+    c[k].pool_base = ins->pool_size;
+    ins->pool_size += c[k].pool_size;
+    i |= c[k].nomem;
+  }
+  ins->pool = i? NULL: malloc(ins->pool_size > 0? ins->pool_size: 1);
+  if (ins->pool == NULL) {
+    for (k = 0; k < n; ++k)
+      free(c[k].pool);
+    return -1;
+  }
+  run_chunks(c, n, pool_chunk);
+  return 0;
 }
 
-void print_reg(struct registers *reg) {
+void *count_chunk(void *arg) {
+  struct chunk *c = arg;
   int i;
-  char buffer[buffer_size];
-  for (i = 0; i < s_max; ++i) {
-    snprintf(buffer, buffer_size, "%s = %d", reg->s_name[i], reg->s[i]);
-    if (i % 4 == 3)
-      printf("%s\n", buffer);
-    else 
-      printf("%-20s", buffer);
-  }
-  for (i = 0; i < t_max; ++i) {
-    snprintf(buffer, buffer_size, "%s = %d", reg->t_name[i], reg->t[i]);
-    if ((i + s_max) % 4 == 3 || i == t_max - 1)
-      printf("%s\n", buffer);
-    else 
-      printf("%-20s", buffer);
+  for (i = c->begin; i < c->end; ++i)
+    if (c->ins->o_ins[i].label)
+      ++c->l_count;
+    else
+      ++c->le_count;
+  return NULL;
+}
+
+void *label_chunk(void *arg) {
+  struct chunk *c = arg;
+  struct instructions *ins = c->ins;
+  int i;
+  int le_count = c->le_base;
+  int l_count = c->l_base;
+  for (i = c->begin; i < c->end; ++i) {
+    if (ins->o_ins[i].label) {
+      ins->l_pos[l_count] = le_count;
+      ins->l[l_count] = i;
+      ++l_count;
+    } else {
+      ins->le_ins[le_count] = i;
+      ++le_count;
+    }
   }
+  return NULL;
 }
 
-void ins_parse(const char *ins, char parsed[4][buffer_size]) {
-  assert(strcmp(ins, "nop"));
+void *target_chunk(void *arg) {
+  struct chunk *c = arg;
+  struct instructions *ins = c->ins;
+  int i, j;
+  for (i = c->begin; i < c->end; ++i) {
+    struct line *ln = &ins->o_ins[ins->le_ins[i]];
+    ins->target[i] = -1;
+    if (ins->text[ln->t[0].off] != 'b')
+      continue;                         // only branches have a target
+    j = label_find(ins, c->h_label, c->h_size, &ln->t[3]);
+    if (c->h_label[j] != -1)
+      ins->target[i] = ins->l_pos[c->h_label[j]];
+  }
+  return NULL;
+}
+
+int label_find(struct instructions *ins, int *h_label, int h_size,
+  struct token *t) {
+  int j;
+  const char *name = ins->text + t->off;
+  unsigned int hash = 2166136261u;      // FNV-1a
+  for (j = 0; j < t->len; ++j)
+    hash = (hash ^ (unsigned char)name[j]) * 16777619u;
+  for (j = hash & (h_size - 1); h_label[j] != -1; j = (j + 1) & (h_size - 1)) {
+    struct token *u = &ins->o_ins[ins->l[h_label[j]]].t[0];
+    if (u->len == t->len && memcmp(ins->text + u->off, name, t->len) == 0)
+      break;
+  }
+  return j;
+}
+
+int chunk_count(size_t size) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  long n = (long)(size / chunk_min);
+  if (n > cores)
+    n = cores;
+  if (n > chunk_max)
+    n = chunk_max;
+  return n < 1? 1: (int)n;
+}
+
+void run_chunks(struct chunk c[], int n, void *(*fn)(void *)) {
+  int k;
+  pthread_t thread[chunk_max];
+  int started[chunk_max];
+  // the first chunk runs in the calling thread, and a chunk also runs there
+  // if its thread cannot be created
+  for (k = 1; k < n; ++k) {
+    started[k] = pthread_create(&thread[k], NULL, fn, &c[k]) == 0;
+    if (!started[k])
+      fn(&c[k]);
+  }
+  if (n > 0)
+    fn(&c[0]);
+  for (k = 1; k < n; ++k)
+    if (started[k])
+      pthread_join(thread[k], NULL);
+}
+
+void program_free(struct instructions *ins) {
+  if (ins->text != NULL)
+    munmap((void *)ins->text, ins->size);
+  free(ins->o_ins);
+  free(ins->le_ins);
+  free(ins->l);
+  free(ins->l_pos);
+  free(ins->target);
+  free(ins->pool);
+  free(ins->le_text);
+  free(ins->op);
+  jit_free(ins);
+  ins->text = NULL;
+  ins->o_ins = NULL;
+  ins->le_ins = NULL;
+  ins->l = NULL;
+  ins->l_pos = NULL;
+  ins->target = NULL;
+  ins->pool = NULL;
+  ins->le_text = NULL;
+  ins->op = NULL;
+}
+
+void *intern_chunk(void *arg) {
+  struct chunk *c = arg;
+  struct instructions *ins = c->ins;
+  int i, j;
+  int capacity = 0;                     // capacity of the string pool
+  int h_size = 1024;                    // size of the hash table of texts
+  int h_count = 0;                      // count of distinct texts
+  int *h_text = malloc(sizeof(int) * h_size);
+  c->pool = NULL;
+  c->pool_size = 0;
+  if (h_text == NULL) {
+    c->nomem = 1;
+    return NULL;
+  }
+  for (j = 0; j < h_size; ++j)
+    h_text[j] = -1;
+  for (i = c->begin; i < c->end; ++i) {
+    struct token *t = ins->o_ins[ins->le_ins[i]].t;
+    char buffer[buffer_size << 2];
+    int len = 0;
+    for (j = 0; j < 4; ++j) {           // op + ' ' + rd + ',' + rs + ',' + rt
+      memcpy(buffer + len, ins->text + t[j].off, t[j].len);
+      len += t[j].len;
+      buffer[len++] = j == 0? ' ': ',';
+    }
+    buffer[--len] = '\0';
+    unsigned int hash = 2166136261u;    // FNV-1a
+    for (j = 0; j < len; ++j)
+      hash = (hash ^ (unsigned char)buffer[j]) * 16777619u;
+    for (j = hash & (h_size - 1); h_text[j] != -1; j = (j + 1) & (h_size - 1))
+      if (strcmp(c->pool + h_text[j], buffer) == 0)
+        break;
+    if (h_text[j] == -1) {              // store the text at its first time
+      while (c->pool_size + len + 1 > capacity) {
+        char *pool;
+        capacity = capacity? capacity << 1: 4096;
+        pool = realloc(c->pool, capacity);
+        if (pool == NULL) {             // the pool so far is freed by
+          c->nomem = 1;                 // label_preprocess()
+          free(h_text);
+          return NULL;
+        }
+        c->pool = pool;
+      }
+      memcpy(c->pool + c->pool_size, buffer, len + 1);
+      h_text[j] = c->pool_size;
+      c->pool_size += len + 1;
+      if (++h_count << 1 > h_size) {    // keep the hash table half empty
+        int k, *old = h_text;
+        h_text = malloc(sizeof(int) * (h_size << 1));
+        if (h_text == NULL) {
+          c->nomem = 1;
+          free(old);
+          return NULL;
+        }
+        for (k = 0; k < h_size << 1; ++k)
+          h_text[k] = -1;
+        for (k = 0; k < h_size; ++k)
+          if (old[k] != -1) {
+            const char *u = c->pool + old[k];
+            unsigned int g = 2166136261u;
+            for (; *u; ++u)
+              g = (g ^ (unsigned char)*u) * 16777619u;
+            for (j = g & ((h_size << 1) - 1); h_text[j] != -1;
+              j = (j + 1) & ((h_size << 1) - 1))
+              ;
+            h_text[j] = old[k];
+          }
+        h_size <<= 1;
+        free(old);
+        for (j = hash & (h_size - 1); strcmp(c->pool + h_text[j], buffer);
+          j = (j + 1) & (h_size - 1))
+          ;
+      }
+    }
+    ins->le_text[i] = h_text[j];
+  }
+  free(h_text);
+  return NULL;
+}
+
+void *pool_chunk(void *arg) {
+  struct chunk *c = arg;
+  int i;
+  if (c->pool_size > 0)
+    memcpy(c->ins->pool + c->pool_base, c->pool, c->pool_size);
+  for (i = c->begin; i < c->end; ++i)
+    c->ins->le_text[i] += c->pool_base;
+  free(c->pool);
+  c->pool = NULL;
+  return NULL;
+}
+
+const char *ins_text(struct instructions *ins, int pos) {
+  return ins->pool + ins->le_text[pos];
+}
+
+const char *w_text(struct working *wk, int i) {
+  if (wk->w_ins[i] == nop_handle)
+    return nop;
+  return wk->ins[wk->w_tid[i]].pool + wk->w_ins[i];
+}
+
+void print_table(FILE *report, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1]) {
+  // variable declaration
+  int i, j;
+  char symbol[7][4];                    // symbol store int-string conversion
+
+  // initialize the data
+  strcpy(symbol[0], ".");
+  strcpy(symbol[1], "IF");
+  strcpy(symbol[2], "ID");
+  strcpy(symbol[3], "EX");
+  strcpy(symbol[4], "MEM");
+  strcpy(symbol[5], "WB");
+  strcpy(symbol[6], "*");
+
+  // print the first row
+  fprintf(report, "CPU Cycles ===>     ");
+  for (i = 1; i < cycle_max; ++i)
+    fprintf(report, "%-4d", wk->base + i);
+  fprintf(report, "%d\n", wk->base + cycle_max);
+
+  // print the rest of the table
+  for (i = 0; i < wk->w_count; ++i) {
+    if (wk->threads > 1) {              // tag the instruction with its thread
+      char tagged[buffer_size + 8];
+      snprintf(tagged, sizeof(tagged), "%d:%s", wk->w_tid[i], w_text(wk, i));
+      fprintf(report, "%-20s", tagged);
+    } else
+      fprintf(report, "%-20s", w_text(wk, i));
+    for (j = 1; j < cycle_max; ++j) {
+      if (w_table[i][j] >= 7) {
+        fprintf(stderr, "w_count = %d\n", wk->w_count);
+        fprintf(stderr, "ERROR: w_table[%d][%d] = %d\n", i, j, w_table[i][j]);
+      }
+      assert(w_table[i][j] >= 0);
+      assert(w_table[i][j] < 7);
+      fprintf(report, "%-4s", symbol[w_table[i][j]]);
+    }
+    fprintf(report, "%s\n", symbol[w_table[i][cycle_max]]);
+  }
+}
+
+void print_frame(struct config *cfg, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int src) {
+  int i;
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  fprintf(cfg->report, "%s\n", buffer);
+  print_table(cfg->report, wk, w_table); // print the pipelined table
+  fprintf(cfg->report, "\n");         // print a new line
+  for (i = 0; i < cfg->threads && src != source_replay; ++i) {
+    if (cfg->threads > 1)
+      fprintf(cfg->report, "thread %d\n", i);
+    print_reg(cfg->report, &reg[i]);    // print the registers
+  }
+}
+
+void print_reg(FILE *report, struct registers *reg) {
+  int i;
+  char buffer[buffer_size];
+  for (i = 0; i < s_max; ++i) {
+    snprintf(buffer, buffer_size, "%s = %d", reg->s_name[i], reg->s[i]);
+    if (i % 4 == 3)
+      fprintf(report, "%s\n", buffer);
+    else 
+      fprintf(report, "%-20s", buffer);
+  }
+  for (i = 0; i < t_max; ++i) {
+    snprintf(buffer, buffer_size, "%s = %d", reg->t_name[i], reg->t[i]);
+    if ((i + s_max) % 4 == 3 || i == t_max - 1)
+      fprintf(report, "%s\n", buffer);
+    else 
+      fprintf(report, "%-20s", buffer);
+  }
+}
+
+void ins_parse(const char *ins, char parsed[4][buffer_size]) {
+  assert(strcmp(ins, "nop"));
   int i, j;
   for (i = 0; i < 4; ++i)
     for (j = 0; j < buffer_size; ++j)
@@ -267,31 +2256,37 @@ int reg_access(struct registers *reg, char v[buffer_size]) {
     return reg->s[v[2] - '0'];
 }
 
-void set_reg_access(struct registers *reg, char v[buffer_size]) {
-  assert(v[0] == '$');
-  assert(v[1] == 's' || v[1] == 't');
-  if (v[1] == 't')
-    reg->t_access[v[2] - '0'] = 1;
+void set_reg_access(struct registers *reg, int slot) {
+  assert(slot >= 0 && slot < t_max + s_max);
+  if (slot < t_max)
+    reg->t_access[slot] = 1;
   else
-    reg->s_access[v[2] - '0'] = 1;
+    reg->s_access[slot - t_max] = 1;
 }
 
-void reset_reg_access(struct registers *reg, char v[buffer_size]) {
-  assert(v[0] == '$');
-  assert(v[1] == 's' || v[1] == 't');
-  if (v[1] == 't')
-    reg->t_access[v[2] - '0'] = 0;
+void reset_reg_access(struct registers *reg, int slot) {
+  assert(slot >= 0 && slot < t_max + s_max);
+  if (slot < t_max)
+    reg->t_access[slot] = 0;
+  else
+    reg->s_access[slot - t_max] = 0;
+}
+
+int check_reg_access(struct registers *reg, int slot) {
+  assert(slot >= 0 && slot < t_max + s_max);
+  if (slot < t_max)
+    return reg->t_access[slot];
   else
-    reg->s_access[v[2] - '0'] = 0;
+    return reg->s_access[slot - t_max];
 }
 
-int check_reg_access(struct registers *reg, char v[buffer_size]) {
+int reg_index(const char *v) {
   assert(v[0] == '$');
   assert(v[1] == 's' || v[1] == 't');
   if (v[1] == 't')
-    return reg->t_access[v[2] - '0'];
+    return v[2] - '0';
   else
-    return reg->s_access[v[2] - '0'];
+    return t_max + v[2] - '0';
 }
 
 int *reg_modify(struct registers *reg, char v[buffer_size]) {
@@ -303,13 +2298,13 @@ int *reg_modify(struct registers *reg, char v[buffer_size]) {
     return &reg->s[v[2] - '0'];
 }
 
-void calculate(struct registers *reg, char *ins) {
+void calculate(struct registers *reg, const char *ins) {
   assert(strcmp(ins, nop) && ins[0] != 'b');
   char parsed[4][buffer_size];
   ins_parse(ins, parsed);
   int *rd = reg_modify(reg, parsed[1]);
   if (strcmp(parsed[0], "add") == 0 || strcmp(parsed[0], "addi") == 0)
-    *rd = reg_access(reg, parsed[2]) + reg_access(reg, parsed[3]);
+    *rd = add_wrap(reg_access(reg, parsed[2]), reg_access(reg, parsed[3]));
   else if (strcmp(parsed[0], "and") == 0 || strcmp(parsed[0], "andi") == 0)
     *rd = reg_access(reg, parsed[2]) & reg_access(reg, parsed[3]);
   else if (strcmp(parsed[0], "or") == 0 || strcmp(parsed[0], "ori") == 0)
@@ -327,214 +2322,4415 @@ void check_w_table(int w_table[cycle_max << 2][cycle_max + 1]) {
 }
 #endif
 
-void pipeline(struct registers *reg, struct instructions *ins, int forwarding) {
-  // variable declaration
-  int i, j, k;
-  int time;                             // frame of time
-  int w_table[cycle_max << 2][cycle_max + 1];
-  // table for the pipelined execution. NOTE: the count of working instruction
-  // may exceeds cycle_max due to the insertion of nops
-  int w_done[cycle_max];                // record the completion of instructions
-  int next_ins;                         // next instruction to be pipelined
-  // NOTE: 0 = ".", 1 = "IF", 2 = "ID", 3 = "EX", 4 = "MEM", 5 = "WB", 6 = "*"
-
+int machine_begin(struct machine *m, struct registers reg[],
+  struct instructions ins[], struct config *cfg, struct stats *st, int src,
+  int out) {
+  int i;
   // initialize the data
-  time = 0;
-  next_ins = 0;
-  for (i = 0; i < cycle_max; ++i) {
-    for (j = 0; j <= cycle_max; ++j)
-      w_table[i][j] = 0;
-    w_done[i] = 0;
+  m->reg = reg;
+  m->ins = ins;
+  m->cfg = cfg;
+  m->st = st;
+  m->time = 0;
+  m->last = -1;
+  for (i = 0; i < thread_max; ++i) {
+    m->next_ins[i] = i < cfg->threads && fetch_ready(&ins[i], cfg, 0)? 0: -1;
+    m->cursor[i] = 0;
   }
+  memset(m->w_table, 0, sizeof(m->w_table));
+  memset(m->w_done, 0, sizeof(m->w_done));
+  m->wk.ins = ins;
+  m->wk.w_count = 0;
+  m->wk.next_id = 0;
+  m->wk.threads = cfg->threads;
+  m->wk.base = 0;
+  memset(st, 0, sizeof(*st));
+  memset(m->lv, 0, sizeof(m->lv));
+  m->cnt = out == output_record && cfg->series? &cfg->series->now: NULL;
+  m->sample = m->cnt? cfg->series->period: 0;
+  m->ss = NULL;
+  m->touch = NULL;
+  if (out == output_record && cfg->timeline)
+    timeline_begin(cfg->timeline, cfg->threads);
+  // loops can be fast-forwarded only if no cycle is printed or traced
+  if (cfg->threads == 1 && out == output_none && src == source_execute) {
+    m->ss = calloc(1, sizeof(struct steady));
+    if (m->ss == NULL)
+      return -1;
+  }
+  m->wr = NULL;
+  if (out && cfg->verbose) {
+    // nothing is printed by the writer before the first frame is sent
+    if ((m->wr = writer_start(cfg, ins, src)) == NULL)
+      return -1;
+    if (cfg->forwarding)
+      fprintf(cfg->report, "START OF SIMULATION (forwarding)\n");
+    else
+      fprintf(cfg->report, "START OF SIMULATION (no forwarding)\n");
+  }
+  return 0;
+}
 
-  // simulate pipelining
-  if (forwarding)
-    printf("START OF SIMULATION (forwarding)\n");
-  else
-    printf("START OF SIMULATION (no forwarding)\n");
-  while (time < cycle_max) {
-    int stall = 0;                      // flag for stall of pipelining
-    ++time;                             // increment the frame of time
-    for (i = 0; i < ins->w_count; ++i)
-      if (w_done[i] == 0) {             // if this instruction is not done
-        if (w_table[i][time - 1] == 6)  // if previous stage is a bubble
-          w_table[i][time] = 6;         // the next stage should be a bubble
-        else                            // else, increment the stage
-          w_table[i][time] = w_table[i][time - 1] + 1;
-      }
-    for (i = 0; i < ins->w_count; ++i) {
-      if (w_table[i][time - 1] == 6) {    // handle the special case of nop
-        for (j = time; j >= 0; j--)       // and invalidated instruction
-          if (w_table[i][j] != 6)         // find the most recent non-bubble
-            break;                        // stage and record the position j
-        // we assume that bubbles should simulate all the stages, e.g.
-        // IF ID ID ID EX * *, or IF ID ID ID ID ID * * *.
-        if (w_table[i][j] <= 5 && j + 5 - w_table[i][j] == time - 1) {
-          w_table[i][time] = 0;
-          w_done[i] = 1;
-        }
+// record that pos is checked for an instruction in cycle, which only a watched
+// run does
+static inline void machine_touch(struct machine *m, int pos, int cycle) {
+  if (m->touch && pos >= 0 && cycle < m->touch[pos])
+    m->touch[pos] = cycle;
+}
+
+// drop the states to find steady loops when their log cannot grow, so that
+// the run can go on exactly without fast-forward
+static inline void machine_forget(struct machine *m) {
+  free(m->ss->log);
+  free(m->ss);
+  m->ss = NULL;
+}
+
+// the decoded instruction of row i of the window, which is not a nop
+static inline const struct op *machine_op(struct machine *m, int src, int i) {
+  if (src == source_stream)
+    return &m->cfg->stream->op[m->wk.w_pc[i] % stream_ring];
+  return &m->ins[m->wk.w_tid[i]].op[m->wk.w_pc[i]];
+}
+
+static inline __attribute__((always_inline))
+int machine_cycle(struct machine *m, int fw, int src, int out) {
+  // variable declaration
+  int i, j, k;
+  struct registers *reg = m->reg;
+  struct instructions *ins = m->ins;
+  struct config *cfg = m->cfg;
+  struct stats *st = m->st;
+  int time = m->time;                   // frame of time
+  int (*w_table)[cycle_max + 1] = m->w_table;
+  int *w_done = m->w_done;
+  int *next_ins = m->next_ins;
+  int last = m->last;
+  int *cursor = m->cursor;
+  // the recorders are only looked up in the runs which record the cycles
+  struct steady *ss = out == output_none? m->ss: NULL;
+  struct livelock *lv = m->lv;
+  struct working *wk = &m->wk;
+  struct counters *cnt = out == output_record? m->cnt: NULL;
+  struct profile *prof = out == output_record? cfg->prof: NULL;
+  int stall = 0;                      // flag for stall of pipelining
+  int hazard = 0;                     // flag for stall of data hazard
+  int backward = -1;                  // taken backward branch, or -1
+  int nomem = 0;                      // 1 if the log of loops is dropped
+  slide_window(wk, w_table, w_done, &time);
+  ++time;                             // increment the frame of time
+  for (i = 0; i < wk->w_count; ++i)
+    if (w_done[i] == 0) {             // if this instruction is not done
+      if (w_table[i][time - 1] == 6)  // if previous stage is a bubble
+        w_table[i][time] = 6;         // the next stage should be a bubble
+      else                            // else, increment the stage
+        w_table[i][time] = w_table[i][time - 1] + 1;
+    }
+  for (i = 0; i < wk->w_count; ++i) {
+    int tid = wk->w_tid[i];            // hardware thread of this instruction
+    struct registers *r = &reg[tid];  // register file of this thread
+    if (w_table[i][time - 1] == 6) {    // handle the special case of nop
+      for (j = time; j >= 0; j--)       // and invalidated instruction
+        if (w_table[i][j] != 6)         // find the most recent non-bubble
+          break;                        // stage and record the position j
+      // we assume that bubbles should simulate all the stages, e.g.
+      // IF ID ID ID EX * *, or IF ID ID ID ID ID * * *.
+      if (w_table[i][j] <= 5 && j + 5 - w_table[i][j] == time - 1) {
+        w_table[i][time] = 0;
+        w_done[i] = 1;
       }
-      if (strcmp(ins->w_ins[i], nop) == 0)// only if the instruction is not
-        continue;                         // nop, we continue to parsing
-      char parsed[4][buffer_size];
-      ins_parse(ins->w_ins[i], parsed);
-      // reset the register access flag immediately after EX or WB
-      if (ins->w_ins[i][0] != 'b' && forwarding && w_table[i][time - 1] == 3)
-        reset_reg_access(reg, parsed[1]);
-      if (ins->w_ins[i][0] != 'b' && !forwarding && w_table[i][time - 1] == 5)
-        reset_reg_access(reg, parsed[1]);
-      if (w_done[i] == 1)               // if this instruction is done
-        continue;                       // skip to next instruction
-      if (w_table[i][time] == 5)
-        w_done[i] = 1;                  // set the w_done state after WB
-      // handle the data hazard when encounter EX or MEM, depending on whether
-      // it is a branch instruction or not
-      if ((w_table[i][time] == 3 && ins->w_ins[i][0] != 'b') ||
-        (w_table[i][time] == 4 && ins->w_ins[i][0] == 'b')) {
-        int nop_count = 0;              // count of nop that need to be added
-        int reg_access_state = 0;       // access state of register
-        // check for access state of rs, rt, and determine nop_count
-        int a = ins->w_ins[i][0] == 'b'? 1: 2;
-        int b = ins->w_ins[i][0] == 'b'? 3: 4;
-        // for branch instruction, rd and rs are dependent registers
-        // for non-branch instruction, rs and rt are dependent registers
-        for (j = a; j < b; ++j)
-          if (parsed[j][0] == '$' && strcmp(parsed[j], "$zero")) {
-            if (check_reg_access(reg, parsed[j]) == 1) {
-              reg_access_state = 1;       // the register is busy for use
-              // data hazard has occurred
-              if (strcmp(ins->w_ins[i - 1], nop)
-                && ins->w_ins[i - 1][0] != 'b') {
-                // only check with previous instruction if it is not a branch
-                // instruction or nop
-                char parsed1[4][buffer_size];
-                ins_parse(ins->w_ins[i - 1], parsed1);
-                if (strcmp(parsed1[1], parsed[j]) == 0) {
-                  nop_count = 2;
-                  break;
-                }
+    }
+    if (wk->w_ins[i] == nop_handle)      // only if the instruction is not
+      continue;                         // nop, we continue to decoding
+    const struct op *op = machine_op(m, src, i);
+    int branch = op_branch(op->code);
+    // reset the register access flag immediately after EX or WB
+    if (!branch && fw && w_table[i][time - 1] == 3)
+      reset_reg_access(r, op->rd);
+    if (!branch && !fw && w_table[i][time - 1] == 5)
+      reset_reg_access(r, op->rd);
+    if (w_done[i] == 1)               // if this instruction is done
+      continue;                       // skip to next instruction
+    if (w_table[i][time] == 5) {
+      w_done[i] = 1;                  // set the w_done state after WB
+      ++st->retired[tid];
+      if (cnt)
+        ++cnt->retired;
+    }
+    // handle the data hazard when encounter EX or MEM, depending on whether
+    // it is a branch instruction or not
+    if ((w_table[i][time] == 3 && !branch) ||
+      (w_table[i][time] == 4 && branch)) {
+      int nop_count = 0;              // count of nop that need to be added
+      int reg_access_state = 0;       // access state of register
+      int busy = -1;                  // register that causes the stall
+      // check for access state of rs, rt, and determine nop_count
+      // for branch instruction, rd and rs are dependent registers
+      // for non-branch instruction, rs and rt are dependent registers
+      for (j = 0; j < 2; ++j)
+        if (op->use[j] != -1) {
+          int use = op->use[j];
+          if (check_reg_access(r, use) == 1) {
+            if (!reg_access_state)
+              busy = use;
+            reg_access_state = 1;       // the register is busy for use
+            // data hazard has occurred, and only the instructions of the
+            // same thread can be the cause of it
+            if (i - 1 >= 0 && wk->w_tid[i - 1] == tid
+              && wk->w_ins[i - 1] != nop_handle
+              && !op_branch(machine_op(m, src, i - 1)->code)) {
+              // only check with previous instruction if it is not a branch
+              // instruction or nop
+              if (machine_op(m, src, i - 1)->lead == use) {
+                nop_count = 2;
+                busy = use;
+                break;
               }
-              if (i - 2 >= 0 && strcmp(ins->w_ins[i - 2], nop)
-                && ins->w_ins[i - 1][0] != 'b') {
-                // only check with previous two instruction if it exists, and
-                // it is not a branch instruction or nop
-                char parsed2[4][buffer_size];
-                ins_parse(ins->w_ins[i - 2], parsed2);
-                if (strcmp(parsed2[1], parsed[j]) == 0)
-                  nop_count = 1;
+            }
+            if (i - 2 >= 0 && wk->w_tid[i - 2] == tid
+              && wk->w_ins[i - 2] != nop_handle
+              && (wk->w_ins[i - 1] == nop_handle
+              || !op_branch(machine_op(m, src, i - 1)->code))) {
+              // only check with previous two instruction if it exists, and
+              // it is not a branch instruction or nop
+              if (machine_op(m, src, i - 2)->lead == use) {
+                nop_count = 1;
+                busy = use;
               }
             }
           }
-        if (nop_count > 0) {
-          // add nop to the working instructions
-          for (j = ins->w_count - 1 + nop_count; j >= i + nop_count; --j) {
-            // shift w_ins
-            strcpy(ins->w_ins[j], ins->w_ins[j - nop_count]);
-            // shift w_done
-            w_done[j] = w_done[j - nop_count];
-            // shift w_table
-            for (k = 1; k <= time; ++k)
-              w_table[j][k] = w_table[j - nop_count][k];
-            // when adding nop, all subsequent instructions should remain to
-            // be in the stage of the last frame of time
-            w_table[j][time] = w_table[j][time - 1];
-          }
-          for (j = i; j < i + nop_count; ++j) {
-            strcpy(ins->w_ins[j], nop);   // update w_ins
-            w_done[j] = 0;                // update w_done
-            for (k = 1; k <= time; ++k)   // update w_table
-              w_table[j][k] = w_table[i][k];
-            w_table[j][time] = 6;
-          }
-          ins->w_count += nop_count;      // update w_count
-          stall = 1;                      // set the stall flag
-        } else if (reg_access_state) {
-          // no need to add nop, but still stall due to two consecutive nops
-          for (j = i; j < ins->w_count; j++)
-            w_table[j][time] = w_table[j][time - 1];
-          stall = 1;                      // set the stall flag
-        } else {
-          // if no need to add nop or to stall, then just go to EX
-          if (ins->w_ins[i][0] != 'b')      // set the register access state
-            set_reg_access(reg, parsed[1]); // for a non-branch instruction
         }
+      if (reg_access_state && prof)     // this cycle is lost by the RAW
+        profile_add(prof, tid, wk->w_pc[i], cause_raw, busy, 1);
+      if (nop_count > 0) {
+        // add nop to the working instructions
+        for (j = wk->w_count - 1 + nop_count; j >= i + nop_count; --j) {
+          // shift w_ins
+          wk->w_ins[j] = wk->w_ins[j - nop_count];
+          wk->w_tid[j] = wk->w_tid[j - nop_count];
+          wk->w_pc[j] = wk->w_pc[j - nop_count];
+          wk->w_id[j] = wk->w_id[j - nop_count];
+          // shift w_done
+          w_done[j] = w_done[j - nop_count];
+          // shift w_table
+          for (k = 0; k <= time; ++k)
+            w_table[j][k] = w_table[j - nop_count][k];
+          // when adding nop, all subsequent instructions should remain to
+          // be in the stage of the last frame of time
+          w_table[j][time] = w_table[j][time - 1];
+        }
+        for (j = i; j < i + nop_count; ++j) {
+          wk->w_ins[j] = nop_handle;     // update w_ins
+          wk->w_tid[j] = tid;            // the nop belongs to the same thread
+          wk->w_pc[j] = -1;
+          wk->w_id[j] = wk->next_id++;
+          w_done[j] = 0;                // update w_done
+          for (k = 0; k <= time; ++k)   // update w_table
+            w_table[j][k] = w_table[i][k];
+          w_table[j][time] = 6;
+        }
+        wk->w_count += nop_count;        // update w_count
+        st->nops += nop_count;
+        if (cnt)
+          cnt->bubbles += nop_count;
+        stall = 1;                      // set the stall flag
+        hazard = 1;
+      } else if (reg_access_state) {
+        // no need to add nop, but still stall due to two consecutive nops
+        for (j = i; j < wk->w_count; j++)
+          w_table[j][time] = w_table[j][time - 1];
+        stall = 1;                      // set the stall flag
+        hazard = 1;
+      } else {
+        // if no need to add nop or to stall, then just go to EX
+        if (!branch)                    // set the register access state
+          set_reg_access(r, op->rd);    // for a non-branch instruction
+        // count the operands forwarded from the instructions ahead of this
+        // one which have not passed WB yet
+        for (j = 0; cnt && fw && j < 2; ++j)
+          if (op->use[j] != -1)
+            for (k = i - 1; k >= 0; --k)
+              if (wk->w_tid[k] == tid && wk->w_ins[k] != nop_handle
+                && w_table[k][time] != 6 && w_table[k][time - 1] != 5) {
+                const struct op *older = machine_op(m, src, k);
+                if (op_branch(older->code))
+                  continue;
+                if (older->rd == op->use[j]) {
+                  ++cnt->forwarded;
+                  break;
+                }
+              }
       }
-      // handle the control hazard immediately after MEM
-      if (w_table[i][time] == 5 && ins->w_ins[i][0] == 'b') {
-        int redirect;
-        int a, b;
-        char parsed[4][buffer_size];
-        ins_parse(ins->w_ins[i], parsed);
-        a = reg_access(reg, parsed[1]);
-        b = reg_access(reg, parsed[2]);
-        assert(!(strcmp(parsed[0], "bne") && strcmp(parsed[0], "beq")));
-        if (strcmp(parsed[0], "bne") == 0)
-          redirect = (a != b);
-        else
-          redirect = (a == b);
-        if (redirect) {
-          // redirect the next instruction
-          int location = -1;
-          for (j = 0; j < ins->l_count; ++j)
-            if (strcmp(ins->l[j], parsed[3]) == 0) {
-              location = ins->l_pos[j];
-              break;
-            }
-          assert(location >= 0);
-          next_ins = location;
-          // invalidate previous guess
-          for (j = i + 1; j < ins->w_count; ++j)
+    }
+    // handle the control hazard immediately after MEM
+    if (w_table[i][time] == 5 && branch) {
+      int redirect;
+      if (src == source_stream)         // the outcome is in the stream
+        redirect = cfg->stream->taken[wk->w_pc[i] % stream_ring];
+      else if (src == source_replay)    // the outcome is in the trace
+        redirect = replay_branch(cfg->replay, tid, &cursor[tid], wk->w_pc[i]);
+      else
+        redirect = execute(&ins[tid], r, wk->w_pc[i]);
+      if (ss && steady_commit(ss, wk->w_pc[i], redirect)) {
+        machine_forget(m);
+        ss = NULL;
+        nomem = 1;
+      }
+      if (cnt && redirect)
+        ++cnt->taken;
+      else if (cnt)
+        ++cnt->not_taken;
+      if (redirect) {
+        // redirect the next instruction of this thread
+        // a stream goes on after the branch, whatever the outcome is
+        int location = src == source_stream? wk->w_pc[i] + 1:
+          ins[tid].target[wk->w_pc[i]];
+        assert(location >= 0);
+        if (location <= wk->w_pc[i]) {
+          backward = wk->w_pc[i];
+          // the registers are known only if the program is executed
+          if (src == source_execute && !st->stuck_period[tid]) {
+            int value[slot_count];
+            slot_load(value, r);
+            int period = livelock_check(&lv[tid], wk->w_pc[i], value);
+            if (period)
+              livelock_found(st, tid, wk->w_pc[i], period, wk->base + time);
+          }
+        }
+        next_ins[tid] = location;
+        // invalidate previous guess, instructions of the other threads are
+        // not on the wrong path and go on
+        int flushed = 0;
+        for (j = i + 1; j < wk->w_count; ++j)
+          if (wk->w_tid[j] == tid) {
+            if (wk->w_ins[j] != nop_handle)
+              ++flushed;
             w_table[j][time] = 6;
-          // restore previous access of registers
-          for (j = i + 1; j < ins->w_count; ++j) {
-            if (strcmp(ins->w_ins[j], nop) && ins->w_ins[j][0] != 'b' && ins->w_ins[j][i - 1] >= 3) {
-              char parsed[4][buffer_size];
-              ins_parse(ins->w_ins[j] ,parsed);
-              reset_reg_access(reg, parsed[1]);
-            }
           }
-          // immediately add the redirected instruction
-          if (0 <= next_ins && next_ins < ins->le_count) {
-            // if next location is pointing to some valid instruction
-            strcpy(ins->w_ins[ins->w_count++], ins->le_ins[next_ins]);
-            next_ins = next_ins + 1;
+        st->flushed += flushed;
+        if (cnt)
+          cnt->flushed += flushed;
+        if (flushed && prof)            // the fetch of the wrong path is lost
+          profile_add(prof, tid, wk->w_pc[i], cause_control, -1, flushed);
+        // restore previous access of registers
+        for (j = i + 1; j < wk->w_count; ++j) {
+          if (wk->w_tid[j] == tid && wk->w_ins[j] != nop_handle
+            && w_table[j][time - 1] >= 3) {
+            const struct op *later = machine_op(m, src, j);
+            if (!op_branch(later->code))
+              reset_reg_access(r, later->rd);
           }
-          if (next_ins >= ins->le_count)      // if current instruction is the last
-            next_ins = -1;                    // there is no next instruction
-          w_table[ins->w_count - 1][time] = 1;
-          stall = 1;                          // temporarily set the stall flag
-          // to evade the insertion of instruction routinely at the end
         }
+        // immediately add the redirected instruction
+        machine_touch(m, next_ins[tid], wk->base + time);
+        if (0 <= next_ins[tid] && fetch_ready(&ins[tid], cfg, next_ins[tid])) {
+          // if next location is pointing to some valid instruction
+          wk->w_tid[wk->w_count] = tid;
+          wk->w_pc[wk->w_count] = next_ins[tid];
+          wk->w_id[wk->w_count] = wk->next_id++;
+          wk->w_ins[wk->w_count++] = fetch_handle(&ins[tid], cfg, next_ins[tid]);
+          w_table[wk->w_count - 1][time] = 1;
+          next_ins[tid] = next_ins[tid] + 1;
+        }
+        machine_touch(m, next_ins[tid], wk->base + time);
+        if (!fetch_ready(&ins[tid], cfg, next_ins[tid])) // if current
+          next_ins[tid] = -1;           // instruction is the last one
+        last = tid;
+        stall = 1;                          // temporarily set the stall flag
+        // to evade the insertion of instruction routinely at the end
       }
-      // handle the register calculation immediately after WB
-      if (w_table[i][time] == 5 && ins->w_ins[i][0] != 'b')
-        calculate(reg, ins->w_ins[i]);
     }
-    if (!stall) {
-      if (next_ins != -1) {               // if there is next instruction
-        strcpy(ins->w_ins[ins->w_count++], ins->le_ins[next_ins]);
-        next_ins = next_ins + 1;          // increment the next_ins
-        w_table[ins->w_count - 1][time] = 1;
+    // handle the register calculation immediately after WB
+    if (w_table[i][time] == 5 && !branch && src == source_execute) {
+      execute(&ins[tid], r, wk->w_pc[i]);
+      if (ss && steady_commit(ss, wk->w_pc[i], 0)) {
+        machine_forget(m);
+        ss = NULL;
+        nomem = 1;
       }
-      if (next_ins >= ins->le_count)      // if current instruction is the last
-        next_ins = -1;                    // there is no next instruction
-    } else
-      stall = 0;
-    // print out the results
+    }
+  }
+  if (!stall) {
+    int t = fetch_thread(wk, w_table, w_done, next_ins, last, cfg, time);
+    if (t != -1) {                      // if there is next instruction
+      wk->w_tid[wk->w_count] = t;
+      wk->w_pc[wk->w_count] = next_ins[t];
+      wk->w_id[wk->w_count] = wk->next_id++;
+      wk->w_ins[wk->w_count++] = fetch_handle(&ins[t], cfg, next_ins[t]);
+      next_ins[t] = next_ins[t] + 1;    // increment the next_ins
+      w_table[wk->w_count - 1][time] = 1;
+      machine_touch(m, next_ins[t], wk->base + time);
+      if (!fetch_ready(&ins[t], cfg, next_ins[t])) // if current instruction
+        next_ins[t] = -1;               // is the last, there is no next one
+      last = t;
+    }
+    // the other threads which are ready lose this cycle of fetch
+    for (j = 0; prof && t != -1 && j < cfg->threads; ++j)
+      if (j != t && next_ins[j] != -1)
+        profile_add(prof, j, next_ins[j], cause_structural, -1, 1);
+  } else
+    stall = 0;
+  st->stalls += hazard;
+  if (ss && backward != -1)
+    steady_state(ss, wk, w_table, w_done, next_ins[0], reg, ins, cfg, st,
+      &lv[0], backward, time);
+  if (out == output_record && cfg->trace)
+    trace_cycle(cfg->trace, wk, w_table, time);
+  if (out == output_record && cfg->timeline)
+    timeline_cycle(cfg->timeline, wk, w_table, reg, time);
+  if (out == output_record && cfg->golden)
+    golden_cycle(cfg->golden, wk, w_table, reg, time);
+  // sample the counters every period
+  if (cnt) {
+    ++cnt->cycles;
+    for (i = 0; i < wk->w_count; ++i)
+      if (wk->w_ins[i] != nop_handle
+        && w_table[i][time] >= 1 && w_table[i][time] <= 5)
+        ++cnt->occupancy[w_table[i][time] - 1];
+    if (--m->sample == 0) {             // one cycle passes in every call
+      series_emit(cfg->series, wk->base + time);
+      m->sample = cfg->series->period;
+    }
+  }
+  if (src == source_stream && (wk->base + time) % stream_period == 0)
+    print_stream(cfg->stream, st, wk->base + time);
+  // print out the results
+  if (out == output_print)
+    writer_frame(m->wr, wk, w_table, reg, time);
+  // end the pipeline after the completion of all instructions, except the
+  // ones of threads which never end
+  for (i = 0; i < cfg->threads; ++i)
+    if (next_ins[i] != -1 && !st->stuck_period[i])
+      break;
+  for (j = 0; j < wk->w_count; ++j)
+    if (w_done[j] == 0 && !st->stuck_period[wk->w_tid[j]])
+      break;
+  m->time = time;
+  m->last = last;
+  if (nomem)
+    return -1;
+  return i == cfg->threads && j == wk->w_count;
+}
+
+void machine_end(struct machine *m, int out) {
+  struct config *cfg = m->cfg;
+  struct stats *st = m->st;
+  struct working *wk = &m->wk;
+  struct counters *cnt = m->cnt;
+  struct steady *ss = m->ss;
+  st->cycles = wk->base + m->time;
+  if (ss) {
+    free(ss->log);
+    free(ss);
+  }
+  if (cnt)                              // the rest of the last period
+    series_emit(cfg->series, st->cycles);
+  if (out == output_record && cfg->trace)
+    trace_close(cfg->trace, wk, st->cycles);
+  if (out == output_record && cfg->timeline)
+    timeline_close(cfg->timeline, st->cycles);
+  if (m->wr) {                          // every frame is printed before
+    writer_stop(m->wr);                 // the end
+    m->wr = NULL;
+  }
+  if (out && cfg->verbose) {
     char buffer[buffer_size];
     memset(buffer, '-', 82);
     buffer[82] = '\0';
-    printf("%s\n", buffer);
-    print_table(ins, w_table);          // print the pipelined table
-    printf("\n");                       // print a new line
-    print_reg(reg);                     // print the registers
-    // end the pipeline after the completion of last instruction
-    if (w_done[ins->w_count - 1])
+    fprintf(cfg->report, "%s\n", buffer);
+    fprintf(cfg->report, "END OF SIMULATION\n");
+  }
+  m->ss = NULL;
+}
+
+struct writer *writer_start(struct config *cfg, struct instructions ins[],
+  int src) {
+  int i;
+  struct writer *wr = calloc(1, sizeof(struct writer));
+  if (wr == NULL)
+    return NULL;
+  wr->cfg = cfg;
+  wr->src = src;
+  wr->sent.ins = ins;
+  wr->sent.threads = cfg->threads;
+  wr->wk.ins = ins;
+  wr->wk.threads = cfg->threads;
+  for (i = 0; i < thread_max; ++i)
+    data_init(&wr->reg[i], NULL);
+  pthread_mutex_init(&wr->lock, NULL);
+  pthread_cond_init(&wr->wake, NULL);
+  if (pthread_create(&wr->thread, NULL, writer_run, wr) != 0) {
+    pthread_cond_destroy(&wr->wake);
+    pthread_mutex_destroy(&wr->lock);
+    free(wr);
+    return NULL;
+  }
+  return wr;
+}
+
+void writer_frame(struct writer *wr, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time) {
+  int i, j;
+  struct working *sent = &wr->sent;
+  // the writer has the last frame sent, so only the differences are sent
+  if (wk->base != sent->base) {
+    writer_push(wr, record_shift, wk->base - sent->base, 0, 0, 0);
+    table_shift(wr->sent_table, wk->base - sent->base);
+    sent->base = wk->base;
+  }
+  writer_push(wr, record_frame, wk->base, wk->w_count, time, 0);
+  sent->w_count = wk->w_count;
+  for (i = 0; i < wk->w_count; ++i) {
+    if (sent->w_tid[i] != wk->w_tid[i] || sent->w_ins[i] != wk->w_ins[i]
+      || sent->w_id[i] != wk->w_id[i]) {
+      writer_push(wr, record_row, i, wk->w_tid[i], wk->w_ins[i], wk->w_id[i]);
+      sent->w_tid[i] = wk->w_tid[i];
+      sent->w_ins[i] = wk->w_ins[i];
+      sent->w_id[i] = wk->w_id[i];
+    }
+    if (memcmp(&wr->sent_table[i][1], &w_table[i][1],
+      sizeof(int) * cycle_max) == 0)
+      continue;
+    for (j = 1; j <= cycle_max; ++j)
+      if (wr->sent_table[i][j] != w_table[i][j]) {
+        writer_push(wr, record_cell, i, j, w_table[i][j], 0);
+        wr->sent_table[i][j] = w_table[i][j];
+      }
+  }
+  for (i = 0; i < wk->threads && wr->src != source_replay; ++i)
+    for (j = 0; j < t_max + s_max; ++j) {
+      int v = j < t_max? reg[i].t[j]: reg[i].s[j - t_max];
+      if (wr->sent_value[i][j] != v) {
+        writer_push(wr, record_reg, i, j, v, 0);
+        wr->sent_value[i][j] = v;
+      }
+    }
+  writer_push(wr, record_print, 0, 0, 0, 0);
+  writer_publish(wr);
+}
+
+void writer_stop(struct writer *wr) {
+  writer_publish(wr);
+  __atomic_store_n(&wr->done, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&wr->lock);
+  pthread_cond_broadcast(&wr->wake);
+  pthread_mutex_unlock(&wr->lock);
+  pthread_join(wr->thread, NULL);
+  pthread_mutex_destroy(&wr->lock);
+  pthread_cond_destroy(&wr->wake);
+  free(wr);
+}
+
+void writer_push(struct writer *wr, int op, int a, int b, int c, int d) {
+  struct record *r;
+  // the ring is lock-free, the lock is only taken to wait for room, after
+  // telling the writer which then wakes the simulation
+  if (wr->pushed - __atomic_load_n(&wr->tail, __ATOMIC_ACQUIRE)
+    == writer_ring) {
+    writer_publish(wr);
+    pthread_mutex_lock(&wr->lock);
+    __atomic_store_n(&wr->full, 1, __ATOMIC_SEQ_CST);
+    while (wr->pushed - __atomic_load_n(&wr->tail, __ATOMIC_SEQ_CST)
+      == writer_ring)
+      pthread_cond_wait(&wr->wake, &wr->lock);
+    __atomic_store_n(&wr->full, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&wr->lock);
+  }
+  r = &wr->ring[wr->pushed++ % writer_ring];
+  r->op = op;
+  r->a = a;
+  r->b = b;
+  r->c = c;
+  r->d = d;
+}
+
+void writer_publish(struct writer *wr) {
+  __atomic_store_n(&wr->head, wr->pushed, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&wr->empty, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&wr->lock);
+    pthread_cond_broadcast(&wr->wake);
+    pthread_mutex_unlock(&wr->lock);
+  }
+}
+
+void *writer_run(void *arg) {
+  struct writer *wr = arg;
+  unsigned tail = 0, head;
+  int header = wr->cfg->journal;        // how to read the journal, which is
+                                        // printed with the first frame
+  for (;;) {
+    head = __atomic_load_n(&wr->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      // the last records are published before done
+      if (__atomic_load_n(&wr->done, __ATOMIC_SEQ_CST)) {
+        if (__atomic_load_n(&wr->head, __ATOMIC_ACQUIRE) == tail)
+          break;
+        continue;
+      }
+      pthread_mutex_lock(&wr->lock);
+      __atomic_store_n(&wr->empty, 1, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&wr->head, __ATOMIC_SEQ_CST) == tail
+        && !__atomic_load_n(&wr->done, __ATOMIC_SEQ_CST))
+        pthread_cond_wait(&wr->wake, &wr->lock);
+      __atomic_store_n(&wr->empty, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&wr->lock);
+      continue;
+    }
+    for (; tail != head; ++tail) {
+      struct record *r = &wr->ring[tail % writer_ring];
+      if (r->op == record_frame) {
+        wr->wk.base = r->a;
+        wr->wk.w_count = r->b;
+        wr->time = r->c;
+      } else if (r->op == record_shift)
+        table_shift(wr->w_table, r->a);
+      else if (r->op == record_row) {
+        wr->wk.w_tid[r->a] = r->b;
+        wr->wk.w_ins[r->a] = r->c;
+        wr->wk.w_id[r->a] = r->d;
+      } else if (r->op == record_cell)
+        wr->w_table[r->a][r->b] = r->c;
+      else if (r->op == record_reg && r->b < t_max)
+        wr->reg[r->a].t[r->b] = r->c;
+      else if (r->op == record_reg)
+        wr->reg[r->a].s[r->b - t_max] = r->c;
+      else if (wr->cfg->journal) {
+        // after the START line, which is printed once the writer is started
+        if (header)
+          fprintf(wr->cfg->report, "JOURNAL %d %d\n", wr->cfg->threads,
+            wr->src != source_replay);
+        header = 0;
+        journal_frame(wr);
+      } else
+        print_frame(wr->cfg, &wr->wk, wr->w_table, wr->reg, wr->src);
+    }
+    __atomic_store_n(&wr->tail, tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&wr->full, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&wr->lock);
+      pthread_cond_broadcast(&wr->wake);
+      pthread_mutex_unlock(&wr->lock);
+    }
+  }
+  return NULL;
+}
+
+void table_shift(int w_table[cycle_max << 2][cycle_max + 1], int k) {
+  int i, j;
+  for (i = 0; i < cycle_max << 2; ++i)
+    for (j = 1; j <= cycle_max; ++j)
+      w_table[i][j] = k < cycle_max && j + k <= cycle_max? w_table[i][j + k]: 0;
+}
+
+void journal_frame(struct writer *wr) {
+  int i, j, k;
+  struct working *wk = &wr->wk;
+  FILE *report = wr->cfg->report;
+  int fresh[cycle_max << 2];            // 1 if the row entered in this frame
+  if (wk->base != wr->jr_base)
+    fprintf(report, "@%d %d\n", wk->base + wr->time, wk->base);
+  else
+    fprintf(report, "@%d\n", wk->base + wr->time);
+  // the rows which left the window, then the ones which entered it. a nop
+  // has the frames before this one of the instruction it stalls, which is
+  // the first row after it that is not new
+  for (j = 0; j < wr->jr_count; ++j) {
+    for (i = 0; i < wk->w_count && wk->w_id[i] != wr->jr_id[j]; ++i)
+      ;
+    if (i == wk->w_count)
+      fprintf(report, "-%d\n", wr->jr_id[j]);
+  }
+  for (i = 0; i < wk->w_count; ++i) {
+    for (j = 0; j < wr->jr_count && wr->jr_id[j] != wk->w_id[i]; ++j)
+      ;
+    fresh[i] = j == wr->jr_count;
+  }
+  for (i = 0; i < wk->w_count; ++i) {
+    if (!fresh[i])
+      continue;
+    if (wk->w_ins[i] != nop_handle) {
+      fprintf(report, "+%d %d %d %s\n", wk->w_id[i], i, wk->w_tid[i],
+        w_text(wk, i));
+      continue;
+    }
+    for (k = i + 1; k < wk->w_count && fresh[k]; ++k)
+      ;
+    fprintf(report, "*%d %d %d %d\n", wk->w_id[i], i, wk->w_tid[i],
+      k < wk->w_count? wk->w_id[k]: -1);
+  }
+  // the stage of every row in this frame, and the registers written
+  for (i = 0; i < wk->w_count; ++i)
+    if (wr->w_table[i][wr->time] != 0)
+      fprintf(report, "%d %s\n", wk->w_id[i],
+        stage_name[wr->w_table[i][wr->time]]);
+  for (i = 0; i < wk->threads && wr->src != source_replay; ++i)
+    for (j = 0; j < t_max + s_max; ++j) {
+      int v = j < t_max? wr->reg[i].t[j]: wr->reg[i].s[j - t_max];
+      if (wr->jr_value[i][j] == v)
+        continue;
+      if (wk->threads > 1)
+        fprintf(report, "%d:", i);
+      fprintf(report, "%s = %d\n", j < t_max? wr->reg[i].t_name[j]:
+        wr->reg[i].s_name[j - t_max], v);
+      wr->jr_value[i][j] = v;
+    }
+  for (i = 0; i < wk->w_count; ++i)
+    wr->jr_id[i] = wk->w_id[i];
+  wr->jr_count = wk->w_count;
+  wr->jr_base = wk->base;
+}
+
+int journal_rebuild(int argc, char **argv) {
+  // variable declaration
+  FILE *in;
+  char line[buffer_size << 2];
+  int i, j, k, n, id, row, tid, v;
+  int lineno = 0, journal = 0, frame = 0, found = 0, end = 0, other;
+  int want, cycle = 0, time = 0, registers = 1;
+  struct config cfg;
+  struct working wk;
+  struct instructions ins[thread_max];
+  struct registers reg[thread_max];
+  int w_table[cycle_max << 2][cycle_max + 1];
+  char text[cycle_max << 2][buffer_size];   // text of the rows, which the
+                                            // pool of every thread points to
+
+  if (argc < 1 || argc > 2) {
+    fprintf(stderr, "ERROR: incorrect number of inputs.\n");
+    return EXIT_FAILURE;
+  }
+  in = strcmp(argv[0], "-") == 0? stdin: fopen(argv[0], "r");
+  if (in == NULL) {
+    fprintf(stderr, "ERROR: cannot open file.\n");
+    return EXIT_FAILURE;
+  }
+  want = argc == 2? atoi(argv[1]): -1;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.report = stdout;
+  memset(ins, 0, sizeof(ins));
+  for (i = 0; i < thread_max; ++i)
+    ins[i].pool = text[0];
+
+  // the lines around a journal are printed as they are, and a frame is
+  // printed when the next one begins or the journal ends
+  for (;;) {
+    end = fgets(line, sizeof(line), in) == NULL;
+    if (!end) {
+      ++lineno;
+      line[strcspn(line, "\r\n")] = '\0';
+    }
+    if (!end && !journal) {
+      if (sscanf(line, "JOURNAL %d %d", &cfg.threads, &registers) == 2) {
+        if (cfg.threads < 1 || cfg.threads > thread_max)
+          break;
+        memset(&wk, 0, sizeof(wk));
+        memset(w_table, 0, sizeof(w_table));
+        for (i = 0; i < thread_max; ++i)
+          data_init(&reg[i], NULL);
+        wk.ins = ins;
+        wk.threads = cfg.threads;
+        journal = 1;
+        frame = 0;
+      } else if (want == -1)
+        printf("%s\n", line);
+      continue;
+    }
+    // a line which is not of the journal ends it
+    other = !end && (!strchr("@-+*$0123456789", line[0])
+      || (!frame && line[0] != '@')
+      || (line[0] == '-' && sscanf(line, "-%d", &id) != 1));
+    if (end || other || line[0] == '@') {
+      if (frame && (want == -1 || want == cycle)) {
+        for (i = 0; i < wk.w_count; ++i)
+          wk.w_ins[i] = wk.w_pc[i] == -1? nop_handle: i * buffer_size;
+        print_frame(&cfg, &wk, w_table, reg,
+          registers? source_execute: source_replay);
+        found = 1;
+      }
+      frame = 0;
+      if (end)
+        break;
+      if (other) {
+        journal = 0;
+        if (want == -1)
+          printf("%s\n", line);
+        continue;
+      }
+      n = sscanf(line, "@%d %d", &cycle, &v);
+      if (n < 1 || (n == 2 && v < wk.base))
+        break;
+      if (n == 2) {
+        table_shift(w_table, v - wk.base);
+        wk.base = v;
+      }
+      time = cycle - wk.base;
+      if (time < 1 || time > cycle_max)
+        break;
+      for (i = 0; i < wk.w_count; ++i)
+        w_table[i][time] = 0;
+      frame = 1;
+      continue;
+    }
+    if (line[0] == '-') {
+      for (row = 0; row < wk.w_count && wk.w_id[row] != id; ++row)
+        ;
+      if (row == wk.w_count)
+        break;
+      for (i = row + 1; i < wk.w_count; ++i) {
+        wk.w_id[i - 1] = wk.w_id[i];
+        wk.w_tid[i - 1] = wk.w_tid[i];
+        wk.w_pc[i - 1] = wk.w_pc[i];
+        strcpy(text[i - 1], text[i]);
+        memcpy(w_table[i - 1], w_table[i], sizeof(w_table[i]));
+      }
+      --wk.w_count;
+      memset(w_table[wk.w_count], 0, sizeof(w_table[0]));
+    } else if (line[0] == '+' || line[0] == '*') {
+      n = 0;
+      if (line[0] == '+')
+        sscanf(line, "+%d %d %d %n", &id, &row, &tid, &n);
+      else if (sscanf(line, "*%d %d %d %d", &id, &row, &tid, &v) == 4)
+        n = 1;
+      if (n == 0 || row < 0 || row > wk.w_count || tid < 0
+        || tid >= cfg.threads || wk.w_count == cycle_max << 2)
+        break;
+      for (i = wk.w_count; i > row; --i) {
+        wk.w_id[i] = wk.w_id[i - 1];
+        wk.w_tid[i] = wk.w_tid[i - 1];
+        wk.w_pc[i] = wk.w_pc[i - 1];
+        strcpy(text[i], text[i - 1]);
+        memcpy(w_table[i], w_table[i - 1], sizeof(w_table[i]));
+      }
+      ++wk.w_count;
+      wk.w_id[row] = id;
+      wk.w_tid[row] = tid;
+      wk.w_pc[row] = line[0] == '+'? 0: -1;
+      memset(w_table[row], 0, sizeof(w_table[row]));
+      text[row][0] = '\0';
+      if (line[0] == '+')
+        snprintf(text[row], buffer_size, "%s", line + n);
+      else
+        for (k = 0; k < wk.w_count; ++k)
+          if (k != row && wk.w_id[k] == v) {
+            memcpy(&w_table[row][1], &w_table[k][1],
+              sizeof(int) * (time - 1));
+            break;
+          }
+    } else if (strchr(line, '$')) {
+      char name[8];
+      tid = 0;
+      if (line[0] != '$' && sscanf(line, "%d:", &tid) != 1)
+        break;
+      if (sscanf(strchr(line, '$'), "%7s = %d", name, &v) != 2
+        || tid < 0 || tid >= cfg.threads)
+        break;
+      for (j = 0; j < t_max && strcmp(reg[tid].t_name[j], name); ++j)
+        ;
+      for (k = 0; k < s_max && strcmp(reg[tid].s_name[k], name); ++k)
+        ;
+      if (j < t_max)
+        reg[tid].t[j] = v;
+      else if (k < s_max)
+        reg[tid].s[k] = v;
+      else
+        break;
+    } else {
+      char stage[8];
+      if (sscanf(line, "%d %7s", &id, stage) != 2)
+        break;
+      for (row = 0; row < wk.w_count && wk.w_id[row] != id; ++row)
+        ;
+      for (k = 1; k < 7 && strcmp(stage_name[k], stage); ++k)
+        ;
+      if (row == wk.w_count || k == 7)
+        break;
+      w_table[row][time] = k;
+    }
+  }
+  if (in != stdin)
+    fclose(in);
+  if (!end) {
+    fprintf(stderr, "ERROR: invalid journal at line %d.\n", lineno);
+    return EXIT_FAILURE;
+  }
+  if (want != -1 && !found) {
+    fprintf(stderr, "ERROR: no cycle %d in the journal.\n", want);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int machine_step(struct machine *m) {
+  if (m->cfg->forwarding)
+    return machine_cycle(m, 1, source_execute, output_none);
+  return machine_cycle(m, 0, source_execute, output_none);
+}
+
+int pipeline_source(struct config *cfg) {
+  if (cfg->stream)
+    return source_stream;
+  if (cfg->replay)
+    return source_replay;
+  return source_execute;
+}
+
+int pipeline_output(struct config *cfg) {
+  if (cfg->prof || cfg->series || cfg->trace || cfg->timeline || cfg->golden)
+    return output_record;
+  return cfg->verbose? output_print: output_none;
+}
+
+int pipeline(struct registers reg[], struct instructions ins[],
+  struct config *cfg, struct stats *st) {
+  struct machine m;                     // state of the pipeline
+  int fw = cfg->forwarding? 1: 0;
+  int src = pipeline_source(cfg);
+  int out = pipeline_output(cfg);
+  int status = 0;
+  if (machine_begin(&m, reg, ins, cfg, st, src, out))
+    return -1;
+  // simulate pipelining
+  while (cfg->limit == 0 || m.wk.base + m.time < cfg->limit)
+    if ((status = machine_cycle(&m, fw, src, out)))
       break;
+  machine_end(&m, out);
+  return status == -1? -1: 0;
+}
+
+int fetch_thread(struct working *wk, int w_table[cycle_max << 2][cycle_max + 1],
+  int w_done[cycle_max << 2], int next_ins[thread_max], int last,
+  struct config *cfg, int time) {
+  int i, j, t;
+  int best = -1;                        // thread with the fewest instructions
+  int best_count = 0;                   // in IF and ID for ICOUNT
+  // visit the threads in the round-robin order starting after the last one,
+  // which also breaks the ties of ICOUNT
+  for (i = 1; i <= cfg->threads; ++i) {
+    t = (last + i) % cfg->threads;
+    if (next_ins[t] == -1)              // skip the threads that are finished
+      continue;
+    if (cfg->policy == policy_rr)
+      return t;
+    int count = 0;
+    for (j = 0; j < wk->w_count; ++j)
+      if (wk->w_tid[j] == t && w_done[j] == 0
+        && (w_table[j][time] == 1 || w_table[j][time] == 2))
+        ++count;
+    if (best == -1 || count < best_count) {
+      best = t;
+      best_count = count;
+    }
   }
+  return best;
+}
+
+void print_smt_report(struct config *cfg, struct stats *smt,
+  struct stats alone[thread_max]) {
+  int i;
+  int retired = 0;                      // instructions of all threads
+  int cycles = 0;                       // cycles of running back to back
   char buffer[buffer_size];
+  FILE *report = cfg->report;
   memset(buffer, '-', 82);
   buffer[82] = '\0';
-  printf("%s\n", buffer);
-  printf("END OF SIMULATION\n");
+  fprintf(report, "%s\n", buffer);
+  fprintf(report, "MULTITHREADING REPORT (%d threads, %s fetch)\n", cfg->threads,
+    cfg->policy == policy_icount? "ICOUNT": "round-robin");
+  fprintf(report, "%-8s%-14s%-12s%-12s%-14s%s\n", "thread", "instructions", "cycles",
+    "CPI", "cycles alone", "CPI alone");
+  for (i = 0; i < cfg->threads; ++i) {
+    retired += smt->retired[i];
+    cycles += alone[i].cycles;
+    fprintf(report, "%-8d%-14d%-12d", i, smt->retired[i], smt->cycles);
+    if (smt->retired[i])
+      fprintf(report, "%-12.2f", (double)smt->cycles / smt->retired[i]);
+    else
+      fprintf(report, "%-12s", "-");
+    fprintf(report, "%-14d", alone[i].cycles);
+    if (alone[i].retired[0])
+      fprintf(report, "%.2f\n", (double)alone[i].cycles / alone[i].retired[0]);
+    else
+      fprintf(report, "-\n");
+  }
+  // utilization is the fraction of cycles in which an instruction completes,
+  // as at most one instruction can be in each stage of the pipeline
+  fprintf(report, "pipeline utilization: %.1f%% multithreaded, %.1f%% single-thread\n",
+    smt->cycles? 100.0 * retired / smt->cycles: 0.0,
+    cycles? 100.0 * retired / cycles: 0.0);
+  fprintf(report, "total cycles: %d multithreaded, %d single-thread back to back\n",
+    smt->cycles, cycles);
+  if (cfg->limit && smt->cycles == cfg->limit)
+    fprintf(report, "NOTE: the simulation stopped at the limit of %d cycles\n",
+      cfg->limit);
+  for (i = 0; i < cfg->threads; ++i)
+    if (alone[i].livelock)
+      fprintf(report, "NOTE: thread %d never ends alone, stopped at cycle %d\n", i,
+        alone[i].cycles);
+}
+
+void schedule(struct instructions *ins, struct instructions *out, int forwarding) {
+  int j, start, end;
+  *out = *ins;
+  out->jit = NULL;                      // the native code is not shared
+  out->jit_entry = NULL;
+  out->le_ins = malloc(sizeof(int) * (ins->le_count > 0? ins->le_count: 1));
+  out->target = malloc(sizeof(int) * (ins->le_count > 0? ins->le_count: 1));
+  out->le_text = malloc(sizeof(int) * (ins->le_count > 0? ins->le_count: 1));
+  assert(out->le_ins != NULL && out->target != NULL && out->le_text != NULL);
+  // schedule every basic block, which ends before a label or after a branch.
+  // NOTE: a long block is scheduled by pieces of instruction_max instructions
+  start = 0;
+  j = 0;                                // next label to check
+  while (start < ins->le_count) {
+    for (end = start + 1; end < ins->le_count && end - start < instruction_max;
+      ++end) {
+      if (ins->text[ins->o_ins[ins->le_ins[end - 1]].t[0].off] == 'b')
+        break;
+      while (j < ins->l_count && ins->l_pos[j] < end)
+        ++j;
+      if (j < ins->l_count && ins->l_pos[j] == end)
+        break;
+    }
+    schedule_block(ins, out, start, end, forwarding);
+    start = end;
+  }
+  if (threaded_lower(out)) {            // only the command line schedules
+    fprintf(stderr, "ERROR: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void schedule_block(struct instructions *ins, struct instructions *out,
+  int start, int end, int forwarding) {
+  // variable declaration
+  int i, j, k;
+  const char *node[instruction_max + 2];
+  // instructions of the DAG. NOTE: the first p of them are the scheduled
+  // instructions before the block, which are fixed in their slots
+  char parsed[instruction_max + 2][4][buffer_size];
+  int dep[instruction_max + 2][instruction_max + 2];
+  // latency from instruction i to dependent instruction j, or -1 if they are
+  // independent. NOTE: a consumer must be fetched this many slots after the
+  // producer to avoid nops
+  int height[instruction_max + 2];      // longest latency path to block end
+  int issue[instruction_max + 2];       // slot of scheduled instruction
+  int order[instruction_max];           // scheduled order of the block
+  int p = start < 2? start: 2;          // count of the fixed instructions
+  int n = p + end - start;              // count of all the instructions
+  int branch = ins->text[ins->o_ins[ins->le_ins[end - 1]].t[0].off] == 'b';
+  // 1 if the block ends with a branch
+  int slot;
+
+  // build the dependency DAG
+  for (i = 0; i < n; ++i) {
+    node[i] = i < p? ins_text(out, start - p + i): ins_text(ins, start + i - p);
+    ins_parse(node[i], parsed[i]);
+    issue[i] = i < p? i - p: -1;
+  }
+  for (i = 0; i < n; ++i)
+    for (j = 0; j < n; ++j) {
+      dep[i][j] = -1;
+      if (j <= i)
+        continue;
+      // for branch instruction, rd and rs are read and nothing is written
+      // for non-branch instruction, rd is written and rs, rt are read
+      int wi = node[i][0] != 'b';
+      int wj = node[j][0] != 'b';
+      for (k = wj? 2: 1; k < (wj? 4: 3); ++k)
+        if (wi && parsed[j][k][0] == '$' && strcmp(parsed[j][k], "$zero")
+          && strcmp(parsed[i][1], parsed[j][k]) == 0) {
+          // read after write, a branch reads its registers one stage later
+          int lat = forwarding? 1: (wj? 3: 2);
+          if (lat > dep[i][j])
+            dep[i][j] = lat;
+        }
+      for (k = wi? 2: 1; k < (wi? 4: 3); ++k)
+        if (wj && strcmp(parsed[i][k], parsed[j][1]) == 0 && dep[i][j] < 1)
+          dep[i][j] = 1;                // write after read
+      if (wi && wj && strcmp(parsed[i][1], parsed[j][1]) == 0 && dep[i][j] < 1)
+        dep[i][j] = 1;                  // write after write
+    }
+  for (i = n - 1; i >= 0; --i) {
+    height[i] = 1;
+    for (j = i + 1; j < n; ++j)
+      if (dep[i][j] >= 0 && dep[i][j] + height[j] > height[i])
+        height[i] = dep[i][j] + height[j];
+  }
+
+  // list scheduling: fill every slot with the ready instruction that stalls
+  // the least, prefering the longest path to the end of the block
+  slot = 0;
+  for (k = 0; k < n - p; ++k) {
+    int best = -1, best_start = 0;
+    for (j = p; j < n; ++j) {
+      int ready = 1, at = slot;
+      if (issue[j] != -1 || (branch && j == n - 1 && k < n - p - 1))
+        continue;                       // scheduled, or branch not yet last
+      for (i = 0; i < n; ++i)
+        if (dep[i][j] >= 0) {
+          if (i >= p && issue[i] == -1) {
+            ready = 0;
+            break;
+          }
+          if (issue[i] + dep[i][j] > at)
+            at = issue[i] + dep[i][j];
+        }
+      if (!ready)
+        continue;
+      if (best == -1 || at < best_start
+        || (at == best_start && height[j] > height[best])) {
+        best = j;
+        best_start = at;
+      }
+    }
+    assert(best >= 0);
+    issue[best] = best_start;
+    order[k] = best;
+    slot = best_start + 1;
+  }
+  for (k = 0; k < n - p; ++k) {
+    out->le_ins[start + k] = ins->le_ins[start + order[k] - p];
+    out->target[start + k] = ins->target[start + order[k] - p];
+    out->le_text[start + k] = ins->le_text[start + order[k] - p];
+  }
+}
+
+void print_schedule(struct instructions *ins, struct config *cfg) {
+  int i, k;
+  struct instructions scheduled;
+  struct registers r;
+  struct stats original, after;
+  struct config single = *cfg;
+  single.threads = 1;
+  single.verbose = 0;
+  single.prof = NULL;
+  single.series = NULL;
+  single.trace = NULL;
+  single.timeline = NULL;
+  single.golden = NULL;
+  single.replay = NULL;
+  // both versions run to their end, or to a limit far beyond the one of the
+  // simulation printed
+  single.limit = schedule_limit;
+
+  schedule(ins, &scheduled, cfg->forwarding);
+  data_init(&r, NULL);
+  k = pipeline(&r, ins, &single, &original);
+  data_init(&r, NULL);
+  if (k || pipeline(&r, &scheduled, &single, &after)) {
+    fprintf(stderr, "ERROR: out of memory.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  printf("%s\n", buffer);
+  if (cfg->forwarding)
+    printf("SCHEDULED PROGRAM (forwarding)\n");
+  else
+    printf("SCHEDULED PROGRAM (no forwarding)\n");
+  for (i = 0, k = 0; i <= scheduled.le_count; ++i) {
+    // print the labels in front of the instruction they point to
+    for (; k < scheduled.l_count && scheduled.l_pos[k] == i; ++k) {
+      struct token *t = &scheduled.o_ins[scheduled.l[k]].t[0];
+      printf("%.*s:\n", t->len, scheduled.text + t->off);
+    }
+    if (i < scheduled.le_count)
+      printf("%s\n", ins_text(&scheduled, i));
+  }
+  printf("%s\n", buffer);
+  printf("%-12s%-8s%s\n", "", "cycles", "nops");
+  printf("%-12s%-8d%d\n", "original", original.cycles, original.nops);
+  printf("%-12s%-8d%d\n", "scheduled", after.cycles, after.nops);
+  if (original.cycles == single.limit || after.cycles == single.limit)
+    printf("NOTE: the simulation stopped at the limit of %d cycles\n",
+      single.limit);
+  if (original.livelock || after.livelock)
+    printf("NOTE: the program never ends, stopped at a repeated state\n");
+  free(scheduled.le_ins);
+  free(scheduled.target);
+  free(scheduled.le_text);
+  free(scheduled.op);
+}
+
+int grid_option(struct grid *g, const char *spec) {
+  int *values, *count, max;
+  const char *v = strchr(spec, '=');
+  if (v == NULL)
+    return -1;
+  if (strncmp(spec, "forwarding=", v - spec + 1) == 0) {
+    values = g->forwarding;
+    count = &g->n_forwarding;
+  } else if (strncmp(spec, "schedule=", v - spec + 1) == 0) {
+    values = g->schedule;
+    count = &g->n_schedule;
+  } else if (strncmp(spec, "policy=", v - spec + 1) == 0) {
+    values = g->policy;
+    count = &g->n_policy;
+  } else
+    return -1;
+  *count = 0;
+  max = 2;
+  while (*v++) {                        // every value follows '=' or ','
+    int len = strcspn(v, ",");
+    int value;
+    if (len == 1 && (v[0] == 'F' || v[0] == 'N') && values == g->forwarding)
+      value = v[0] == 'F';
+    else if (len == 2 && strncmp(v, "no", 2) == 0 && values == g->schedule)
+      value = 0;
+    else if (len == 3 && strncmp(v, "yes", 3) == 0 && values == g->schedule)
+      value = 1;
+    else if (len == 2 && strncmp(v, "rr", 2) == 0 && values == g->policy)
+      value = policy_rr;
+    else if (len == 6 && strncmp(v, "icount", 6) == 0 && values == g->policy)
+      value = policy_icount;
+    else
+      return -1;
+    if (*count == max)
+      return -1;
+    values[(*count)++] = value;
+    v += len;
+  }
+  return *count > 0? 0: -1;
+}
+
+void run_sweep(struct instructions ins[], struct config *cfg, struct grid *g) {
+  // variable declaration
+  int i, f, s, p, n;
+  struct sweep sw;
+  struct instructions scheduled[2][thread_max];
+  struct replay rp[3];                  // trace of the original program and
+                                        // of the scheduled ones
+  int whole[3];                         // 1 if every program of a trace ends
+  int workers;
+  pthread_t thread[chunk_max];
+
+  // unspecified dimensions take the value of the command line
+  if (g->n_forwarding == 0)
+    g->forwarding[g->n_forwarding++] = cfg->forwarding;
+  if (g->n_schedule == 0)
+    g->schedule[g->n_schedule++] = 0;
+  if (g->n_policy == 0 || cfg->threads == 1) {
+    g->n_policy = 0;
+    g->policy[g->n_policy++] = cfg->policy;
+  }
+
+  // the programs are decoded once, and are only read by the workers. the
+  // scheduled programs are prepared for every forwarding setting in use
+  for (f = 0; f < 2; ++f)
+    for (i = 0; i < cfg->threads; ++i)
+      scheduled[f][i].le_ins = NULL;
+  for (s = 0; s < g->n_schedule; ++s)
+    if (g->schedule[s])
+      for (f = 0; f < g->n_forwarding; ++f)
+        if (scheduled[g->forwarding[f]][0].le_ins == NULL)
+          for (i = 0; i < cfg->threads; ++i)
+            schedule(&ins[i], &scheduled[g->forwarding[f]][i],
+              g->forwarding[f]);
+
+  // every program is executed once, and every run only times its trace. a
+  // cut trace has no outcome for the branches past its end, so the runs of
+  // a program which may never end execute it
+  memset(rp, 0, sizeof(rp));
+  for (f = 0; f < 3; ++f) {
+    whole[f] = 0;
+    if (f == 2 || scheduled[f][0].le_ins != NULL) {
+      rp[f].threads = cfg->threads;
+      whole[f] = 1;
+      for (i = 0; i < cfg->threads; ++i) {
+        capture(f == 2? &ins[i]: &scheduled[f][i], &rp[f], i);
+        whole[f] &= rp[f].complete[i];
+      }
+    }
+  }
+
+  // build the configurations of the grid
+  sw.count = g->n_forwarding * g->n_schedule * g->n_policy;
+  sw.point = malloc(sizeof(struct point) * sw.count);
+  assert(sw.point != NULL);
+  n = 0;
+  for (f = 0; f < g->n_forwarding; ++f)
+    for (s = 0; s < g->n_schedule; ++s)
+      for (p = 0; p < g->n_policy; ++p) {
+        struct point *pt = &sw.point[n++];
+        pt->cfg = *cfg;
+        pt->cfg.forwarding = g->forwarding[f];
+        pt->cfg.policy = g->policy[p];
+        pt->cfg.verbose = 0;
+        pt->cfg.prof = NULL;
+        pt->cfg.series = NULL;
+        pt->cfg.trace = NULL;
+        pt->cfg.timeline = NULL;
+        pt->cfg.golden = NULL;
+        pt->scheduled = g->schedule[s];
+        pt->ins = g->schedule[s]? scheduled[g->forwarding[f]]: ins;
+        int trace = g->schedule[s]? g->forwarding[f]: 2;
+        pt->cfg.replay = whole[trace]? &rp[trace]: NULL;
+      }
+
+  // run the configurations on a pool of workers
+  sw.next = 0;
+  pthread_mutex_init(&sw.lock, NULL);
+  workers = chunk_count((size_t)-1);   // one worker for every core
+  if (workers > sw.count)
+    workers = sw.count;
+  for (i = 1; i < workers; ++i)
+    if (pthread_create(&thread[i], NULL, sweep_worker, &sw) != 0)
+      break;
+  workers = i;
+  sweep_worker(&sw);
+  for (i = 1; i < workers; ++i)
+    pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&sw.lock);
+
+  // print the table of all configurations
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  printf("%s\n", buffer);
+  printf("SWEEP OF %d CONFIGURATIONS\n", sw.count);
+  printf("%-12s%-10s%-8s%-8s%-14s%-8s%-6s%-8s%s\n", "forwarding", "schedule",
+    "policy", "cycles", "instructions", "CPI", "nops", "stalls", "flushed");
+  for (n = 0; n < sw.count; ++n) {
+    struct point *pt = &sw.point[n];
+    int retired = 0;
+    for (i = 0; i < cfg->threads; ++i)
+      retired += pt->st.retired[i];
+    printf("%-12s%-10s%-8s%-8d%-14d", pt->cfg.forwarding? "F": "N",
+      pt->scheduled? "yes": "no", cfg->threads == 1? "-":
+      pt->cfg.policy == policy_icount? "icount": "rr", pt->st.cycles, retired);
+    if (retired)
+      printf("%-8.2f", (double)pt->st.cycles / retired);
+    else
+      printf("%-8s", "-");
+    printf("%-6d%-8d%d\n", pt->st.nops, pt->st.stalls, pt->st.flushed);
+    if (cfg->limit && pt->st.cycles == cfg->limit)
+      printf("NOTE: the simulation stopped at the limit of %d cycles\n",
+        cfg->limit);
+    if (pt->st.livelock)
+      printf("NOTE: the program never ends, stopped at a repeated state\n");
+  }
+  free(sw.point);
+  for (f = 0; f < 3; ++f)
+    replay_free(&rp[f]);
+  for (f = 0; f < 2; ++f)
+    if (scheduled[f][0].le_ins != NULL)
+      for (i = 0; i < cfg->threads; ++i) {
+        free(scheduled[f][i].le_ins);
+        free(scheduled[f][i].target);
+        free(scheduled[f][i].le_text);
+        free(scheduled[f][i].op);
+      }
+}
+
+void *sweep_worker(void *arg) {
+  struct sweep *sw = arg;
+  for (;;) {
+    int i, n;
+    struct point *pt;                   // configuration of this run
+    struct registers reg[thread_max];   // private state of this run
+    pthread_mutex_lock(&sw->lock);
+    n = sw->next++;
+    pthread_mutex_unlock(&sw->lock);
+    if (n >= sw->count)
+      break;
+    pt = &sw->point[n];
+    for (i = 0; i < pt->cfg.threads; ++i)
+      data_init(&reg[i], NULL);
+    if (pipeline(reg, pt->ins, &pt->cfg, &pt->st)) {
+      fprintf(stderr, "ERROR: out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return NULL;
+}
+
+void profile_add(struct profile *prof, int tid, int pc, int cause, int detail,
+  long long cycles) {
+  int i;
+  if (prof->count << 1 >= prof->size) { // keep the hash table half empty
+    struct hotspot *old = prof->entry;
+    int size = prof->size;
+    prof->size = size? size << 1: 256;
+    prof->entry = malloc(sizeof(struct hotspot) * prof->size);
+    assert(prof->entry != NULL);
+    for (i = 0; i < prof->size; ++i)
+      prof->entry[i].cycles = 0;
+    prof->count = 0;
+    for (i = 0; i < size; ++i)
+      if (old[i].cycles)
+        profile_add(prof, old[i].tid, old[i].pc, old[i].cause, old[i].detail,
+          old[i].cycles);
+    free(old);
+  }
+  unsigned int hash = (unsigned int)pc * 2654435761u
+    ^ (unsigned int)(tid << 24 | cause << 16 | (detail + 1));
+  for (i = hash & (prof->size - 1); prof->entry[i].cycles;
+    i = (i + 1) & (prof->size - 1)) {
+    struct hotspot *h = &prof->entry[i];
+    if (h->tid == tid && h->pc == pc && h->cause == cause && h->detail == detail)
+      break;
+  }
+  if (prof->entry[i].cycles == 0) {
+    prof->entry[i].tid = tid;
+    prof->entry[i].pc = pc;
+    prof->entry[i].cause = cause;
+    prof->entry[i].detail = detail;
+    ++prof->count;
+  }
+  prof->entry[i].cycles += cycles;
+}
+
+int hotspot_compare(const void *a, const void *b) {
+  const struct hotspot *x = a, *y = b;
+  if (x->cycles != y->cycles)
+    return x->cycles < y->cycles? 1: -1;
+  if (x->tid != y->tid)
+    return x->tid - y->tid;
+  if (x->pc != y->pc)
+    return x->pc - y->pc;
+  return x->cause - y->cause;
+}
+
+void print_profile(struct instructions ins[], struct config *cfg,
+  struct profile *prof, struct stats *st) {
+  // variable declaration
+  int i, j, t, n;
+  long long lost = 0;                   // cycles lost by all causes
+  struct hotspot *sorted;
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+
+  // sort the hot spots by the cycles they lost
+  sorted = malloc(sizeof(struct hotspot) * (prof->count + 1));
+  assert(sorted != NULL);
+  for (i = 0, n = 0; i < prof->size; ++i)
+    if (prof->entry[i].cycles) {
+      sorted[n++] = prof->entry[i];
+      lost += prof->entry[i].cycles;
+    }
+  qsort(sorted, n, sizeof(struct hotspot), hotspot_compare);
+
+  printf("%s\n", buffer);
+  printf("STALL PROFILE (%s), %d cycles, %lld lost\n",
+    cfg->forwarding? "forwarding": "no forwarding", st->cycles, lost);
+  if (cfg->limit && st->cycles == cfg->limit)
+    printf("NOTE: the simulation stopped at the limit of %d cycles\n",
+      cfg->limit);
+  printf("%-8s%-8s%-8s%-8s%-22s%s\n", "cycles", "share", "thread", "line",
+    "cause", "instruction");
+  for (i = 0; i < n; ++i) {
+    struct hotspot *h = &sorted[i];
+    char cause[buffer_size];
+    if (h->cause == cause_raw)
+      snprintf(cause, buffer_size, "RAW on $%c%d",
+        h->detail < t_max? 't': 's',
+        h->detail < t_max? h->detail: h->detail - t_max);
+    else if (h->cause == cause_control)
+      snprintf(cause, buffer_size, "taken branch flush");
+    else
+      snprintf(cause, buffer_size, "fetch by other thread");
+    printf("%-8lld%-8.1f%-8d%-8d%-22s%s\n", h->cycles,
+      100.0 * h->cycles / lost, h->tid,
+      ins[h->tid].o_ins[ins[h->tid].le_ins[h->pc]].number, cause,
+      ins_text(&ins[h->tid], h->pc));
+  }
+  free(sorted);
+
+  // annotate every line of the source with the cycles lost at it
+  for (t = 0; t < cfg->threads; ++t) {
+    struct instructions *p = &ins[t];
+    int lines = p->o_count > 0? p->o_ins[p->o_count - 1].number: 0;
+    long long *line_lost = calloc(lines + 1, sizeof(long long));
+    assert(line_lost != NULL);
+    for (i = 0; i < prof->size; ++i)
+      if (prof->entry[i].cycles && prof->entry[i].tid == t)
+        line_lost[p->o_ins[p->le_ins[prof->entry[i].pc]].number]
+          += prof->entry[i].cycles;
+    printf("%s\n", buffer);
+    if (cfg->threads > 1)
+      printf("ANNOTATED SOURCE (thread %d)\n", t);
+    else
+      printf("ANNOTATED SOURCE\n");
+    printf("%-8s%-8s%s\n", "lost", "line", "source");
+    for (i = 0, j = 1; j <= lines; ++j) {
+      int end = i;
+      while (end < (int)p->size && p->text[end] != '\n')
+        ++end;
+      int len = end - i;
+      if (len > 0 && p->text[end - 1] == '\r')
+        --len;                          // strip of the last '\r'
+      if (line_lost[j])
+        printf("%-8lld%-8d%.*s\n", line_lost[j], j, len, p->text + i);
+      else
+        printf("%-8s%-8d%.*s\n", "", j, len, p->text + i);
+      i = end + 1;
+    }
+    free(line_lost);
+  }
+}
+
+int series_open(struct series *s, const char *spec, const char *path) {
+  char *end;
+  long period = strtol(spec, &end, 10);
+  size_t len = strlen(path);
+  if (*spec == '\0' || *end != '\0' || period <= 0)
+    return -1;
+  memset(s, 0, sizeof(*s));
+  s->period = (int)period;
+  s->json = (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+    || (len >= 6 && strcmp(path + len - 6, ".jsonl") == 0);
+  s->out = fopen(path, "w");
+  if (s->out == NULL)
+    return -1;
+  if (!s->json)
+    fprintf(s->out, "cycle,cycles,retired,bubbles,flushed,forwarded,taken,"
+      "not_taken,if,id,ex,mem,wb\n");
+  return 0;
+}
+
+void series_emit(struct series *s, int time) {
+  // variable declaration
+  int i;
+  struct counters *c = &s->now, *l = &s->last;
+  long long d[counter_count];
+
+  if (c->cycles == l->cycles)           // nothing happened in this period
+    return;
+  d[0] = c->cycles - l->cycles;
+  d[1] = c->retired - l->retired;
+  d[2] = c->bubbles - l->bubbles;
+  d[3] = c->flushed - l->flushed;
+  d[4] = c->forwarded - l->forwarded;
+  d[5] = c->taken - l->taken;
+  d[6] = c->not_taken - l->not_taken;
+  for (i = 0; i < 5; ++i)
+    d[7 + i] = c->occupancy[i] - l->occupancy[i];
+  if (s->json) {
+    fprintf(s->out, "{\"cycle\":%d", time);
+    for (i = 0; i < counter_count; ++i)
+      fprintf(s->out, ",\"%s\":%lld", counter_name[i], d[i]);
+    fprintf(s->out, "}\n");
+  } else {
+    fprintf(s->out, "%d", time);
+    for (i = 0; i < counter_count; ++i)
+      fprintf(s->out, ",%lld", d[i]);
+    fprintf(s->out, "\n");
+  }
+  *l = *c;
+}
+
+int trace_open(struct trace *t, const char *format, const char *path) {
+  int i;
+  memset(t, 0, sizeof(*t));
+  if (strcmp(format, "chrome") == 0)
+    t->format = trace_chrome;
+  else if (strcmp(format, "konata") == 0)
+    t->format = trace_konata;
+  else
+    return -1;
+  t->out = fopen(path, "w");
+  if (t->out == NULL)
+    return -1;
+  for (i = 0; i < id_ring; ++i)
+    t->owner[i] = -1;
+  if (t->format == trace_chrome)
+    fprintf(t->out, "[");
+  else
+    fprintf(t->out, "Kanata\t0004\nC=\t0\n");
+  return 0;
+}
+
+void trace_stage(struct trace *t, struct working *wk, int i, int time) {
+  int id = wk->w_id[i];
+  int *stage = &t->stage[id % id_ring];
+  int *since = &t->since[id % id_ring];
+  if (t->format == trace_chrome) {
+    int stall = *stage >= 1 && *stage <= 5? time - *since - 1: 0;
+    fprintf(t->out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+      "\"ts\":%d,\"dur\":%d,\"args\":{\"stall\":%d}}", t->events++? ",": "",
+      stage_name[*stage], wk->w_tid[i], id, *since, time - *since, stall);
+  } else
+    fprintf(t->out, "E\t%d\t0\t%s\n", id, stage_name[*stage]);
+}
+
+void trace_cycle(struct trace *t, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int time) {
+  int i;
+  int cycle = wk->base + time;          // time out of the window
+  if (t->format == trace_konata)
+    fprintf(t->out, "C\t1\n");
+  for (i = 0; i < wk->w_count; ++i) {
+    int id = wk->w_id[i];
+    int *stage = &t->stage[id % id_ring];
+    int *since = &t->since[id % id_ring];
+    int s = w_table[i][time];
+    if (t->owner[id % id_ring] != id) { // the slot is taken by a new number
+      t->owner[id % id_ring] = id;
+      *stage = stage_new;
+    }
+    if (*stage == stage_end || s == *stage) // a stall keeps the stage
+      continue;
+    if (*stage == stage_new) {          // the instruction enters the pipeline
+      const char *text = w_text(wk, i);
+      if (t->format == trace_chrome) {
+        fprintf(t->out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"tid\":%d,\"args\":{\"name\":\"%d %s\"}}", t->events++? ",": "",
+          wk->w_tid[i], id, id, text);
+        fprintf(t->out, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+          "\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+          wk->w_tid[i], id, id);
+      } else {
+        fprintf(t->out, "I\t%d\t%d\t%d\n", id, id, wk->w_tid[i]);
+        fprintf(t->out, "L\t%d\t0\t%s\n", id, text);
+        fprintf(t->out, "S\t%d\t0\t%s\n", id, stage_name[s]);
+      }
+      *stage = s;
+      *since = cycle;
+      continue;
+    }
+    trace_stage(t, wk, i, cycle);       // the last stage is over
+    if (s >= 1 && s <= 5) {
+      if (t->format == trace_konata)
+        fprintf(t->out, "S\t%d\t0\t%s\n", id, stage_name[s]);
+      *stage = s;
+      *since = cycle;
+    } else {                            // done after WB, or flushed
+      int flushed = s == 6;
+      if (t->format == trace_chrome && flushed)
+        fprintf(t->out, ",\n{\"name\":\"flush\",\"ph\":\"i\",\"s\":\"t\","
+          "\"pid\":%d,\"tid\":%d,\"ts\":%d}", wk->w_tid[i], id, cycle);
+      else if (t->format == trace_konata)
+        fprintf(t->out, "R\t%d\t%d\t%d\n", id, t->retired++, flushed);
+      *stage = stage_end;
+    }
+  }
+}
+
+void trace_close(struct trace *t, struct working *wk, int time) {
+  int i;
+  if (t->format == trace_konata)
+    fprintf(t->out, "C\t1\n");
+  for (i = 0; i < wk->w_count; ++i) {   // end the stages still open
+    int id = wk->w_id[i];
+    int stage = t->stage[id % id_ring];
+    if (stage == stage_end)
+      continue;
+    trace_stage(t, wk, i, time + 1);    // only the ones in WB are retired,
+    if (t->format == trace_konata)      // the others are cut by the limit
+      fprintf(t->out, "R\t%d\t%d\t%d\n", id, t->retired++, stage != 5);
+  }
+  if (t->format == trace_chrome)
+    fprintf(t->out, "\n]\n");
+  fclose(t->out);
+}
+
+void tl_put(struct timeline *tl, int byte) {
+  fputc(byte, tl->out);
+  ++tl->size;
+}
+
+void tl_varint(struct timeline *tl, unsigned long long v) {
+  tl->size += put_varint(tl->out, v);
+}
+
+void tl_fixed(struct timeline *tl, unsigned long long v, int bytes) {
+  int i;
+  for (i = 0; i < bytes; ++i)           // little endian
+    tl_put(tl, (int)(v >> (i << 3) & 0xff));
+}
+
+void tl_entry_add(struct tl_entry **index, int *count, int *size, int pos,
+  int cycle, long long offset) {
+  while (pos >= *size) {
+    *size = *size? *size << 1: 256;
+    *index = realloc(*index, sizeof(struct tl_entry) * *size);
+    assert(*index != NULL);
+  }
+  (*index)[pos].cycle = cycle;
+  (*index)[pos].offset = offset;
+  if (pos >= *count)
+    *count = pos + 1;
+}
+
+void tl_snapshot(struct timeline *tl, int time) {
+  int i, j;
+  tl_entry_add(&tl->cycle_index, &tl->cycle_count, &tl->cycle_size,
+    tl->cycle_count, time, tl->size);
+  tl_put(tl, tl_record_snapshot);
+  for (i = 0; i < tl->threads; ++i)
+    for (j = 0; j < t_max + s_max; ++j)
+      tl_varint(tl, zigzag(tl->reg[i][j]));
+}
+
+int timeline_open(struct timeline *tl, const char *path) {
+  memset(tl, 0, sizeof(*tl));
+  tl->out = fopen(path, "wb");
+  return tl->out == NULL? -1: 0;
+}
+
+void timeline_begin(struct timeline *tl, int threads) {
+  int i;
+  tl->threads = threads;
+  for (i = 0; i < id_ring; ++i)
+    tl->owner[i] = -1;
+  fwrite(timeline_magic, 1, 4, tl->out);
+  tl->size = 4;
+  tl_put(tl, timeline_version);
+  tl_varint(tl, threads);
+  tl_snapshot(tl, 0);                   // every register starts from 0
+}
+
+void timeline_cycle(struct timeline *tl, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time) {
+  int i, j;
+  int cycle = wk->base + time;          // time out of the window
+  tl_put(tl, tl_record_cycle);
+  // the stage transitions of the working instructions
+  for (i = 0; i < wk->w_count; ++i) {
+    int id = wk->w_id[i];
+    int *stage = &tl->stage[id % id_ring];
+    int s = w_table[i][time];
+    if (tl->owner[id % id_ring] != id) {
+      tl->owner[id % id_ring] = id;
+      *stage = stage_new;
+    }
+    if (*stage == stage_end || s == *stage)
+      continue;
+    if (*stage == stage_new) {
+      tl_entry_add(&tl->ins_index, &tl->ins_count, &tl->ins_size, id, cycle,
+        tl->size);
+      tl_put(tl, tl_record_enter);
+      tl_varint(tl, id);
+      tl_varint(tl, wk->w_tid[i]);
+      tl_varint(tl, wk->w_pc[i] + 1);   // 0 for nop
+      tl_put(tl, s);
+      *stage = s;
+      continue;
+    }
+    tl_put(tl, tl_record_stage);
+    tl_varint(tl, id);
+    tl_put(tl, s);
+    *stage = s == 0 || s == 6? stage_end: s; // done after WB, or flushed
+  }
+  // the registers written in this frame of time
+  for (i = 0; i < tl->threads; ++i)
+    for (j = 0; j < t_max + s_max; ++j) {
+      int v = j < t_max? reg[i].t[j]: reg[i].s[j - t_max];
+      if (v == tl->reg[i][j])
+        continue;
+      tl_put(tl, tl_record_write);
+      tl_varint(tl, i);
+      tl_varint(tl, j);
+      tl_varint(tl, zigzag(v));
+      tl->reg[i][j] = v;
+    }
+  if (cycle % snapshot_period == 0)
+    tl_snapshot(tl, cycle);
+}
+
+void timeline_close(struct timeline *tl, int time) {
+  int i;
+  long long index = tl->size;
+  for (i = 0; i < tl->cycle_count; ++i) {
+    tl_fixed(tl, tl->cycle_index[i].cycle, 4);
+    tl_fixed(tl, tl->cycle_index[i].offset, 8);
+  }
+  for (i = 0; i < tl->ins_count; ++i) {
+    tl_fixed(tl, tl->ins_index[i].cycle, 4);
+    tl_fixed(tl, tl->ins_index[i].offset, 8);
+  }
+  // footer of a fixed size at the end of the file
+  tl_fixed(tl, index, 8);
+  tl_fixed(tl, tl->cycle_count, 4);
+  tl_fixed(tl, tl->ins_count, 4);
+  tl_fixed(tl, time, 4);
+  fwrite(timeline_magic, 1, 4, tl->out);
+  fclose(tl->out);
+  free(tl->cycle_index);
+  free(tl->ins_index);
+}
+
+unsigned long long zigzag(long long v) {
+  return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+long long unzigzag(unsigned long long v) {
+  return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+unsigned long long tl_get(FILE *in, int bytes) {
+  int i;
+  unsigned long long v = 0;
+  for (i = 0; i < bytes; ++i)
+    v |= (unsigned long long)(fgetc(in) & 0xff) << (i << 3);
+  return v;
+}
+
+unsigned long long tl_get_varint(FILE *in) {
+  int c, shift = 0;
+  unsigned long long v = 0;
+  do {
+    c = fgetc(in);
+    if (c == EOF)
+      return 0;
+    v |= (unsigned long long)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return v;
+}
+
+void tl_read_entry(FILE *in, long long index, int pos, struct tl_entry *e) {
+  fseek(in, (long)(index + 12LL * pos), SEEK_SET);
+  e->cycle = (int)tl_get(in, 4);
+  e->offset = (long long)tl_get(in, 8);
+}
+
+int timeline_query(int argc, char **argv) {
+  // variable declaration
+  FILE *in;
+  char magic[4];
+  int i, threads;
+  long long index;                      // offset of the index
+  int cycle_count, ins_count, cycles;
+  struct tl_entry e;
+  int reg[thread_max][t_max + s_max];
+
+  if (argc < 2) {
+    fprintf(stderr, "ERROR: incorrect number of inputs.\n");
+    return EXIT_FAILURE;
+  }
+  in = fopen(argv[0], "rb");
+  if (in == NULL) {
+    fprintf(stderr, "ERROR: cannot open file.\n");
+    return EXIT_FAILURE;
+  }
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, timeline_magic, 4)
+    || fgetc(in) != timeline_version) {
+    fprintf(stderr, "ERROR: invalid timeline.\n");
+    fclose(in);
+    return EXIT_FAILURE;
+  }
+  threads = (int)tl_get_varint(in);
+  fseek(in, -24, SEEK_END);
+  index = (long long)tl_get(in, 8);
+  cycle_count = (int)tl_get(in, 4);
+  ins_count = (int)tl_get(in, 4);
+  cycles = (int)tl_get(in, 4);
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, timeline_magic, 4)
+    || threads < 1 || threads > thread_max || cycle_count < 1) {
+    fprintf(stderr, "ERROR: invalid timeline.\n");
+    fclose(in);
+    return EXIT_FAILURE;
+  }
+
+  if (strcmp(argv[1], "info") == 0) {
+    printf("%d threads, %d cycles, %d instructions, %d snapshots\n", threads,
+      cycles, ins_count, cycle_count);
+  } else if (strcmp(argv[1], "stage") == 0 && argc == 4) {
+    // find where the instruction enters, and read its transitions until the
+    // cycle. no other part of the timeline is read
+    int n = atoi(argv[2]), c = atoi(argv[3]);
+    int tid = 0, pc = 0, stage = 0, time;
+    if (n < 0 || n >= ins_count) {
+      fprintf(stderr, "ERROR: no instruction #%d.\n", n);
+      fclose(in);
+      return EXIT_FAILURE;
+    }
+    tl_read_entry(in, index, cycle_count + n, &e);
+    if (c < e.cycle) {
+      printf("#%d is not fetched at cycle %d\n", n, c);
+      fclose(in);
+      return EXIT_SUCCESS;
+    }
+    fseek(in, (long)e.offset, SEEK_SET);
+    time = e.cycle;
+    while (ftell(in) < index) {
+      int type = fgetc(in);
+      if (type == tl_record_cycle) {
+        if (++time > c)
+          break;
+      } else if (type == tl_record_enter) {
+        int id = (int)tl_get_varint(in);
+        int t = (int)tl_get_varint(in), p = (int)tl_get_varint(in) - 1;
+        int s = fgetc(in);
+        if (id == n) {
+          tid = t;
+          pc = p;
+          stage = s;
+        }
+      } else if (type == tl_record_stage) {
+        int id = (int)tl_get_varint(in), s = fgetc(in);
+        if (id == n)
+          stage = s;
+      } else if (type == tl_record_write) {
+        tl_get_varint(in);
+        tl_get_varint(in);
+        tl_get_varint(in);
+      } else if (type == tl_record_snapshot) {
+        for (i = 0; i < threads * (t_max + s_max); ++i)
+          tl_get_varint(in);
+      } else
+        break;
+    }
+    printf("#%d (thread %d, ", n, tid);
+    if (pc == -1)
+      printf("nop) ");
+    else
+      printf("instruction %d) ", pc);
+    if (stage >= 1 && stage <= 5)
+      printf("is in %s", stage_name[stage]);
+    else if (stage == 6)
+      printf(pc == -1? "is a bubble": "is flushed");
+    else
+      printf("is retired");
+    printf(" at cycle %d\n", c);
+  } else if (strcmp(argv[1], "regs") == 0 && argc == 3) {
+    // start from the last snapshot before the cycle, and apply the writes
+    // after it
+    int c = atoi(argv[2]), time;
+    int lo = 0, hi = cycle_count - 1;
+    if (c < 0 || c > cycles) {
+      fprintf(stderr, "ERROR: cycle %d is out of 0 to %d.\n", c, cycles);
+      fclose(in);
+      return EXIT_FAILURE;
+    }
+    while (lo < hi) {                   // binary search of the snapshots
+      int mid = (lo + hi + 1) >> 1;
+      tl_read_entry(in, index, mid, &e);
+      if (e.cycle <= c)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    tl_read_entry(in, index, lo, &e);
+    fseek(in, (long)e.offset, SEEK_SET);
+    time = e.cycle;
+    while (ftell(in) < index) {
+      int type = fgetc(in);
+      if (type == tl_record_cycle) {
+        if (++time > c)
+          break;
+      } else if (type == tl_record_enter) {
+        tl_get_varint(in);
+        tl_get_varint(in);
+        tl_get_varint(in);
+        fgetc(in);
+      } else if (type == tl_record_stage) {
+        tl_get_varint(in);
+        fgetc(in);
+      } else if (type == tl_record_write) {
+        int t = (int)tl_get_varint(in), r = (int)tl_get_varint(in);
+        long long v = unzigzag(tl_get_varint(in));
+        if (t < threads && r < t_max + s_max)
+          reg[t][r] = (int)v;
+      } else if (type == tl_record_snapshot) {
+        for (i = 0; i < threads * (t_max + s_max); ++i)
+          reg[i / (t_max + s_max)][i % (t_max + s_max)]
+            = (int)unzigzag(tl_get_varint(in));
+      } else
+        break;
+    }
+    for (i = 0; i < threads; ++i) {
+      struct registers r;
+      data_init(&r, NULL);
+      memcpy(r.t, reg[i], sizeof(r.t));
+      memcpy(r.s, reg[i] + t_max, sizeof(r.s));
+      if (threads > 1)
+        printf("thread %d\n", i);
+      print_reg(stdout, &r);
+    }
+  } else {
+    fprintf(stderr, "ERROR: invalid query.\n");
+    fclose(in);
+    return EXIT_FAILURE;
+  }
+  fclose(in);
+  return EXIT_SUCCESS;
+}
+
+int put_varint(FILE *out, unsigned long long v) {
+  int n = 1;
+  while (v >= 0x80) {                   // 7 bits at a time, low bits first
+    fputc((int)(v & 0x7f) | 0x80, out);
+    v >>= 7;
+    ++n;
+  }
+  fputc((int)v, out);
+  return n;
+}
+
+void capture(struct instructions *ins, struct replay *rp, int tid) {
+  // variable declaration
+  int pc = 0;
+  int size = 256;
+  struct registers reg;
+  int slot[slot_count];
+
+  // execute the instructions one by one, without the pipeline
+  data_init(&reg, NULL);
+  slot_load(slot, &reg);
+  rp->count[tid] = 0;
+  rp->rec[tid] = malloc(sizeof(int) * size);
+  assert(rp->rec[tid] != NULL);
+  while (pc < ins->le_count && rp->count[tid] < capture_max) {
+    int taken = threaded_step(ins, slot, pc);
+    if (rp->count[tid] == size) {
+      size <<= 1;
+      rp->rec[tid] = realloc(rp->rec[tid], sizeof(int) * size);
+      assert(rp->rec[tid] != NULL);
+    }
+    rp->rec[tid][rp->count[tid]++] = pc << 1 | taken;
+    pc = taken? ins->op[pc].target: pc + 1;
+  }
+  rp->complete[tid] = pc >= ins->le_count;
+}
+
+int replay_branch(struct replay *rp, int tid, int *cursor, int pc) {
+  // the branches resolve in the order of the program, so the next record of
+  // the branch is after the one of the last branch
+  while (*cursor < rp->count[tid]) {
+    int rec = rp->rec[tid][(*cursor)++];
+    if (rec >> 1 == pc)
+      return rec & 1;
+  }
+  return 0;                             // not taken beyond the trace
+}
+
+int replay_save(struct replay *rp, const char *path) {
+  int i, j;
+  FILE *out = fopen(path, "wb");
+  if (out == NULL)
+    return -1;
+  fwrite(replay_magic, 1, 4, out);
+  put_varint(out, rp->threads);
+  for (i = 0; i < rp->threads; ++i) {
+    put_varint(out, rp->count[i]);
+    put_varint(out, rp->complete[i]);
+    for (j = 0; j < rp->count[i]; ++j)
+      put_varint(out, rp->rec[i][j]);
+  }
+  fclose(out);
+  return 0;
+}
+
+int replay_load(struct replay *rp, const char *path) {
+  int i, j;
+  char magic[4];
+  FILE *in = fopen(path, "rb");
+  if (in == NULL)
+    return -1;
+  memset(rp, 0, sizeof(*rp));
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, replay_magic, 4)) {
+    fclose(in);
+    return -1;
+  }
+  rp->threads = (int)tl_get_varint(in);
+  for (i = 0; i < rp->threads && i < thread_max; ++i) {
+    rp->count[i] = (int)tl_get_varint(in);
+    rp->complete[i] = (int)tl_get_varint(in);
+    if (rp->count[i] < 0 || rp->count[i] > capture_max)
+      break;
+    rp->rec[i] = malloc(sizeof(int) * (rp->count[i] + 1));
+    assert(rp->rec[i] != NULL);
+    for (j = 0; j < rp->count[i]; ++j)
+      rp->rec[i][j] = (int)tl_get_varint(in);
+  }
+  int bad = i < rp->threads || feof(in); // cut or too many threads
+  fclose(in);
+  if (bad) {
+    replay_free(rp);
+    return -1;
+  }
+  return 0;
+}
+
+void replay_free(struct replay *rp) {
+  int i;
+  for (i = 0; i < thread_max; ++i) {
+    free(rp->rec[i]);
+    rp->rec[i] = NULL;
+  }
+}
+
+void slide_window(struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int *time) {
+  int i, j, k;
+  // drop the instructions at the front that are done, except the ones just
+  // in WB, which free their registers in the next frame of time
+  if (wk->w_count > (cycle_max << 2) - (thread_max << 1) - 2) {
+    for (k = 0; k < wk->w_count; ++k)
+      if (w_done[k] == 0 || w_table[k][*time] == 5)
+        break;
+    for (i = k; i < wk->w_count; ++i) {
+      wk->w_ins[i - k] = wk->w_ins[i];
+      wk->w_tid[i - k] = wk->w_tid[i];
+      wk->w_pc[i - k] = wk->w_pc[i];
+      wk->w_id[i - k] = wk->w_id[i];
+      w_done[i - k] = w_done[i];
+      for (j = 0; j <= *time; ++j)
+        w_table[i - k][j] = w_table[i][j];
+    }
+    for (i = wk->w_count - k; i < wk->w_count; ++i) {
+      w_done[i] = 0;                    // the rows left are empty again
+      for (j = 0; j <= cycle_max; ++j)
+        w_table[i][j] = 0;
+    }
+    wk->w_count -= k;
+    assert(wk->w_count <= (cycle_max << 2) - (thread_max << 1) - 2);
+  }
+  // keep the last frames of time, which are enough to end the bubbles
+  if (*time == cycle_max) {
+    k = cycle_max - window_keep;
+    for (i = 0; i < wk->w_count; ++i)
+      for (j = 0; j <= cycle_max; ++j)
+        w_table[i][j] = j <= window_keep? w_table[i][j + k]: 0;
+    wk->base += k;
+    *time = window_keep;
+  }
+}
+
+int fetch_ready(struct instructions *ins, struct config *cfg, int pos) {
+  if (cfg->stream)
+    return stream_ready(cfg->stream, pos);
+  return pos < ins->le_count;
+}
+
+int fetch_handle(struct instructions *ins, struct config *cfg, int pos) {
+  if (cfg->stream)
+    return pos % stream_ring * buffer_size;
+  return ins->le_text[pos];
+}
+
+int stream_open(struct stream *s, const char *path) {
+  memset(s, 0, sizeof(*s));
+  s->in = strcmp(path, "-") == 0? stdin: fopen(path, "r");
+  return s->in == NULL? -1: 0;
+}
+
+int stream_parse(const char *line, char *out, int *taken) {
+  // variable declaration
+  int count = 0;                        // count of tokens
+  const char *t[5];                     // start of the tokens
+  int len[5];                           // length of the tokens
+  int i = 0;
+
+  // split the line by the same rules as the lexer of programs
+  while (line[i] != '\0' && line[i] != '\n' && line[i] != '#') {
+    int start = i;
+    if (line[i] == ' ' || line[i] == '\t' || line[i] == '\r' || line[i] == ',') {
+      ++i;
+      continue;
+    }
+    while (line[i] != '\0' && line[i] != '\n' && line[i] != '#'
+      && line[i] != ' ' && line[i] != '\t' && line[i] != '\r'
+      && line[i] != ',' && line[i] != ':')
+      ++i;
+    if (line[i] == ':') {               // a label is skipped
+      if (count != 0)
+        return -1;
+      ++i;
+      continue;
+    }
+    if (count == 5)
+      return -1;
+    t[count] = line + start;
+    len[count++] = i - start;
+  }
+  if (count == 0)
+    return 0;
+  // a branch can give its outcome after the label, T or N
+  *taken = 0;
+  if (count == 5) {
+    if (t[0][0] != 'b' || len[4] != 1 || (t[4][0] != 'T' && t[4][0] != 'N'))
+      return -1;
+    *taken = t[4][0] == 'T';
+  } else if (count != 4)
+    return -1;
+  if (!ins_valid(t, len) || len[0] + len[1] + len[2] + len[3] + 4 > buffer_size)
+    return -1;
+  sprintf(out, "%.*s %.*s,%.*s,%.*s", len[0], t[0], len[1], t[1], len[2], t[2],
+    len[3], t[3]);
+  return 1;
+}
+
+int stream_ready(struct stream *s, int pos) {
+  char line[buffer_size << 1];
+  // the instructions before the ring are no longer in the pipeline
+  assert(pos >= s->count - stream_ring);
+  while (pos >= s->count && !s->eof) {
+    int taken, n;
+    if (fgets(line, sizeof(line), s->in) == NULL) {
+      s->eof = 1;
+      break;
+    }
+    ++s->line;
+    n = stream_parse(line, s->pool + s->count % stream_ring * buffer_size,
+      &taken);
+    if (n < 0) {
+      fprintf(stderr, "ERROR: invalid instruction at line %d.\n", s->line);
+      s->error = s->line;
+      s->eof = 1;
+    } else if (n > 0) {
+      // decoded once, as the instructions of a program are
+      char parsed[4][buffer_size];
+      ins_parse(s->pool + s->count % stream_ring * buffer_size, parsed);
+      op_lower(&s->op[s->count % stream_ring], parsed);
+      s->taken[s->count++ % stream_ring] = taken;
+    }
+  }
+  return pos < s->count;
+}
+
+void print_stream(struct stream *s, struct stats *st, int cycles) {
+  int retired = st->retired[0];
+  if (retired > s->last_retired)
+    printf("cycle %d: %d instructions, CPI %.2f, %.2f overall\n", cycles,
+      retired, (double)(cycles - s->last_cycles) / (retired - s->last_retired),
+      (double)cycles / retired);
+  else
+    printf("cycle %d: %d instructions, no instruction retired\n", cycles,
+      retired);
+  fflush(stdout);
+  s->last_cycles = cycles;
+  s->last_retired = retired;
+}
+
+int steady_commit(struct steady *ss, int pc, int taken) {
+  if (ss->log_count == ss->log_size) {
+    int size = ss->log_size? ss->log_size << 1: 256;
+    int *log = realloc(ss->log, sizeof(int) * size);
+    if (log == NULL)
+      return -1;
+    ss->log = log;
+    ss->log_size = size;
+  }
+  ss->log[ss->log_count++] = pc << 1 | taken;
+  return 0;
+}
+
+int steady_signature(struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int next_ins, struct registers *reg, int time, int *sig) {
+  int i, j, n = 0;
+  int start;
+  // the instructions in flight, the ones just in WB which free registers in
+  // the next frame of time, and two done ones before them that the hazards
+  // are checked with
+  for (start = 0; start < wk->w_count; ++start)
+    if (w_done[start] == 0 || w_table[start][time] == 5)
+      break;
+  start = start > 2? start - 2: 0;
+  sig[n++] = next_ins;
+  sig[n++] = wk->w_count - start;
+  for (i = start; i < wk->w_count; ++i) {
+    sig[n++] = wk->w_pc[i];
+    sig[n++] = w_done[i];
+    for (j = time - window_keep + 1; j <= time; ++j)
+      sig[n++] = j >= 0? w_table[i][j]: 0;
+  }
+  for (i = 0; i < t_max; ++i)
+    sig[n++] = reg->t_access[i];
+  for (i = 0; i < s_max; ++i)
+    sig[n++] = reg->s_access[i];
+  return n;
+}
+
+void steady_state(struct steady *ss, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], int w_done[cycle_max << 2],
+  int next_ins, struct registers *reg, struct instructions *ins,
+  struct config *cfg, struct stats *st, struct livelock *lv, int pc,
+  int time) {
+  // variable declaration
+  int i, j, k;
+  int sig[steady_sig];
+  int len = steady_signature(wk, w_table, w_done, next_ins, reg, time, sig);
+  int cycle = wk->base + time;
+
+  for (k = 0; k < steady_max; ++k) {
+    struct snapshot *p = &ss->snap[k];
+    if (k >= ss->count || p->pc != pc || p->len != len
+      || memcmp(p->sig, sig, sizeof(int) * len))
+      continue;
+    // the pipeline is back to the same state at the same branch, so every
+    // iteration that executes the same instructions costs the same cycles.
+    // the registers are updated by executing the iterations in order
+    int period = cycle - p->cycle;
+    int n = 0;                          // count of iterations skipped
+    int slot[slot_count];
+    slot_load(slot, reg);
+    while (cfg->limit == 0 || cycle + (long long)period * (n + 1) <= cfg->limit) {
+      int save[slot_count];
+      memcpy(save, slot, sizeof(slot));
+      for (i = p->log_pos; i < ss->log_count; ++i) {
+        int at = ss->log[i] >> 1;
+        int taken = threaded_step(ins, slot, at);
+        if (taken != (ss->log[i] & 1))
+          break;                        // the loop goes another way
+        if (taken && ins->target[at] <= at && !st->livelock) {
+          int repeat = livelock_check(lv, at, slot);
+          if (repeat)
+            livelock_found(st, 0, at, repeat, cycle + period * (n + 1));
+        }
+      }
+      if (i < ss->log_count) {
+        memcpy(slot, save, sizeof(slot));
+        break;
+      }
+      ++n;
+      if (st->livelock)                 // the loop never ends
+        break;
+    }
+    slot_store(slot, reg);
+    wk->base += period * n;
+    st->retired[0] += (st->retired[0] - p->retired) * n;
+    st->nops += (st->nops - p->nops) * n;
+    st->stalls += (st->stalls - p->stalls) * n;
+    st->flushed += (st->flushed - p->flushed) * n;
+    st->skipped += n;
+    // start over, the log is not needed any more
+    ss->count = 0;
+    ss->next = 0;
+    ss->log_count = 0;
+    return;
+  }
+
+  // remember this state, the oldest one is replaced
+  if (ss->log_count > steady_log) {
+    ss->count = 0;
+    ss->next = 0;
+    ss->log_count = 0;
+  }
+  struct snapshot *p = &ss->snap[ss->next];
+  ss->next = (ss->next + 1) % steady_max;
+  if (ss->count < steady_max)
+    ++ss->count;
+  p->pc = pc;
+  p->cycle = cycle;
+  p->log_pos = ss->log_count;
+  p->retired = st->retired[0];
+  p->nops = st->nops;
+  p->stalls = st->stalls;
+  p->flushed = st->flushed;
+  p->len = len;
+  for (j = 0; j < len; ++j)
+    p->sig[j] = sig[j];
+}
+
+void print_summary(struct registers reg[], struct config *cfg,
+  struct stats *st) {
+  int i;
+  FILE *report = cfg->report;
+  int retired = 0;
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  for (i = 0; i < cfg->threads; ++i)
+    retired += st->retired[i];
+  fprintf(report, "%s\n", buffer);
+  fprintf(report, "SUMMARY (%s)\n",
+    cfg->forwarding? "forwarding": "no forwarding");
+  fprintf(report, "cycles: %d, instructions: %d, CPI: ", st->cycles, retired);
+  if (retired)
+    fprintf(report, "%.2f\n", (double)st->cycles / retired);
+  else
+    fprintf(report, "-\n");
+  fprintf(report, "nops: %d, stalls: %d, flushed: %d\n", st->nops, st->stalls,
+    st->flushed);
+  if (st->skipped)
+    fprintf(report, "iterations of steady loops fast-forwarded: %d\n",
+      st->skipped);
+  if (cfg->limit && st->cycles == cfg->limit)
+    fprintf(report, "NOTE: the simulation stopped at the limit of %d cycles\n",
+      cfg->limit);
+  fprintf(report, "\n");
+  for (i = 0; i < cfg->threads; ++i) {
+    if (cfg->threads > 1)
+      fprintf(report, "thread %d\n", i);
+    print_reg(report, &reg[i]);
+  }
+}
+
+int livelock_check(struct livelock *lv, int pc, const int *value) {
+  int i;
+  unsigned long long hash = 14695981039346656037ULL;
+  // FNV-1a of the branch and the registers
+  hash = (hash ^ (unsigned)pc) * 1099511628211ULL;
+  for (i = 0; i < t_max + s_max; ++i)
+    hash = (hash ^ (unsigned)value[i]) * 1099511628211ULL;
+  // compare with the saved state, which is moved ahead every power of two
+  // states, so a cycle of any length is found within twice its end
+  if (lv->power) {
+    ++lv->lam;
+    if (lv->hash == hash && lv->pc == pc
+      && memcmp(lv->value, value, sizeof(lv->value)) == 0)
+      return lv->lam;
+  }
+  if (lv->lam == lv->power) {
+    lv->hash = hash;
+    lv->pc = pc;
+    memcpy(lv->value, value, sizeof(lv->value));
+    lv->power = lv->power? lv->power << 1: 1;
+    lv->lam = 0;
+  }
+  return 0;
+}
+
+void livelock_found(struct stats *st, int tid, int pc, int period, int cycle) {
+  st->stuck_pc[tid] = pc;
+  st->stuck_period[tid] = period;
+  st->stuck_cycle[tid] = cycle;
+  ++st->livelock;
+}
+
+int print_livelock(struct instructions ins[], struct config *cfg,
+  struct stats *st) {
+  int i;
+  FILE *report = cfg->report;
+  if (!st->livelock)
+    return 0;
+  for (i = 0; i < cfg->threads; ++i)
+    if (st->stuck_period[i]) {
+      fprintf(report, "LIVELOCK: ");
+      if (cfg->threads > 1)
+        fprintf(report, "thread %d ", i);
+      fprintf(report, "the same registers at instruction %d (%s) after %d "
+        "taken backward branch%s, found at cycle %d\n", st->stuck_pc[i],
+        ins_text(&ins[i], st->stuck_pc[i]), st->stuck_period[i],
+        st->stuck_period[i] > 1? "es": "", st->stuck_cycle[i]);
+    }
+  fprintf(report, "NOTE: the simulation stopped at cycle %d since the "
+    "program%s never end%s\n", st->cycles, st->livelock > 1? "s": "",
+    st->livelock > 1? "": "s");
+  return 1;
+}
+
+double run_pipeline(struct registers reg[], struct instructions ins[],
+  struct config *cfg, struct stats *st, int runs) {
+  int i;
+  struct registers r[thread_max];
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (i = 0; i < runs; ++i) {
+    memcpy(r, reg, sizeof(struct registers) * cfg->threads);
+    if (pipeline(r, ins, cfg, st)) {
+      fprintf(stderr, "ERROR: out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+}
+
+void run_benchmark(struct registers reg[], struct instructions ins[],
+  struct config *cfg, int runs) {
+  int i;
+  struct stats st;
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  run_pipeline(reg, ins, cfg, &st, 1);  // warm up the caches
+  double seconds = run_pipeline(reg, ins, cfg, &st, runs);
+  double cycles = (double)runs * (st.cycles? st.cycles: 1);
+  printf("%s\n", buffer);
+  printf("BENCHMARK (%s), %d runs of %d cycles\n",
+    cfg->forwarding? "forwarding": "no forwarding", runs, st.cycles);
+  printf("%-14s%-12s%s\n", "run", "seconds", "ns/cycle");
+  printf("%-14s%-12.3f%.1f\n", "pipeline", seconds, seconds * 1e9 / cycles);
+
+  // the functional execution of every program by the text, the threaded
+  // code and the native code, which must end with the same registers
+  for (i = 0; i < cfg->threads && !cfg->replay; ++i) {
+    struct registers by_text, by_code, by_native;
+    long long count, count_code, count_native;
+    int native = jit_compile(&ins[i]) == 0;
+    double text = run_functional(&ins[i], exec_text, runs, &by_text, &count);
+    double code = run_functional(&ins[i], exec_threaded, runs, &by_code,
+      &count_code);
+    double fast = run_functional(&ins[i], exec_native, runs, &by_native,
+      &count_native);
+    assert(count == count_code && count == count_native);
+    assert(memcmp(by_text.t, by_code.t, sizeof(by_text.t)) == 0);
+    assert(memcmp(by_text.s, by_code.s, sizeof(by_text.s)) == 0);
+    assert(memcmp(by_text.t, by_native.t, sizeof(by_text.t)) == 0);
+    assert(memcmp(by_text.s, by_native.s, sizeof(by_text.s)) == 0);
+    printf("%s\n", buffer);
+    printf("FUNCTIONAL EXECUTION");
+    if (cfg->threads > 1)
+      printf(" (thread %d)", i);
+    printf(", %d runs of %lld instructions\n", runs, count / runs);
+    printf("%-14s%-12s%s\n", "execution", "seconds", "ns/instruction");
+    printf("%-14s%-12.3f%.2f\n", "text", text, text * 1e9 / (count? count: 1));
+    printf("%-14s%-12.3f%.2f\n", "threaded", code,
+      code * 1e9 / (count? count: 1));
+    printf("%-14s%-12.3f%.2f%s\n", "native", fast,
+      fast * 1e9 / (count? count: 1), native? "": " (threaded, no native code)");
+    printf("speedup: %.2fx threaded, %.2fx native\n", code > 0? text / code: 0.0,
+      fast > 0? text / fast: 0.0);
+  }
+}
+
+int threaded_operand(const char *v, int *imm) {
+  if (v[0] != '$') {
+    *imm = atoi(v);
+    return -1;
+  }
+  if (strcmp(v, "$zero") == 0)
+    return slot_zero;
+  return reg_index(v);
+}
+
+int op_slot(const char *v) {
+  if (v[0] != '$' || strcmp(v, "$zero") == 0)
+    return -1;
+  return reg_index(v);
+}
+
+void op_lower(struct op *op, char parsed[4][buffer_size]) {
+  // variable declaration
+  int x = 0, y = 0, a, b, base;
+  // the instructions are checked when they are loaded
+  base = op_base(parsed[0], (int)strlen(parsed[0]));
+  assert(base != -1);
+  // the operands the pipeline checks for hazards: a branch reads its first
+  // two, and an operation writes its first and reads the other two
+  op->lead = op_slot(parsed[1]);
+  if (base == op_beq || base == op_bne) {
+    // the register is compared with the immediate, or the outcome is known
+    int ne = base == op_bne;
+    op->use[0] = op->lead;
+    op->use[1] = op_slot(parsed[2]);
+    a = threaded_operand(parsed[1], &x);
+    b = threaded_operand(parsed[2], &y);
+    op->rd = slot_sink;
+    if (a == -1 && b == -1)
+      op->code = (x != y) == ne? op_jump: op_skip;
+    else if (a == -1 || b == -1) {
+      op->code = ne? op_bnei: op_beqi;
+      op->a = a == -1? b: a;
+      op->b = a == -1? x: y;
+    } else {
+      op->code = ne? op_bne: op_beq;
+      op->a = a;
+      op->b = b;
+    }
+    return;
+  }
+  // the immediate is moved to the second operand, and two immediates are
+  // folded into one
+  op->use[0] = op_slot(parsed[2]);
+  op->use[1] = op_slot(parsed[3]);
+  op->rd = reg_index(parsed[1]);        // never $zero, checked at load
+  a = threaded_operand(parsed[2], &x);
+  b = threaded_operand(parsed[3], &y);
+  if (a == -1 && b == -1) {
+    op->code = op_li;
+    op->b = base == op_add? x + y: base == op_and? x & y:
+      base == op_or? x | y: x < y;
+  } else if (b == -1) {
+    op->code = base + 1;                // the form with an immediate
+    op->a = a;
+    op->b = y;
+  } else if (a == -1) {
+    op->code = base == op_slt? op_sgti: base + 1;
+    op->a = b;
+    op->b = x;
+  } else {
+    op->code = base;
+    op->a = a;
+    op->b = b;
+  }
+}
+
+int threaded_lower(struct instructions *ins) {
+  int pc;
+  ins->op = malloc(sizeof(struct op) * (ins->le_count + 1));
+  if (ins->op == NULL)
+    return -1;
+  for (pc = 0; pc < ins->le_count; ++pc) {
+    struct op *op = &ins->op[pc];
+    char parsed[4][buffer_size];
+    ins_parse(ins_text(ins, pc), parsed);
+    op_lower(op, parsed);
+    op->target = pc + 1;
+    if (op_branch(op->code))
+      op->target = ins->target[pc] >= 0? ins->target[pc]: ins->le_count;
+  }
+  ins->op[ins->le_count].code = op_end;
+  ins->op[ins->le_count].target = ins->le_count;
+  threaded_run(ins, NULL, 0, NULL);     // bind the handlers
+  return 0;
+}
+
+int threaded_run(struct instructions *ins, int *slot, int pc,
+  long long *budget) {
+#ifdef threaded_goto
+  static const void *handler[op_count] = {
+    &&do_op_add, &&do_op_addi, &&do_op_and, &&do_op_andi, &&do_op_or,
+    &&do_op_ori, &&do_op_slt, &&do_op_slti, &&do_op_sgti, &&do_op_li,
+    &&do_op_beq, &&do_op_beqi, &&do_op_bne, &&do_op_bnei, &&do_op_jump,
+    &&do_op_skip, &&do_op_end
+  };
+  int i;
+  if (slot == NULL) {
+    for (i = 0; i <= ins->le_count; ++i)
+      ins->op[i].handler = handler[ins->op[i].code];
+    return 0;
+  }
+#define op_case(code) do_##code:
+#define op_dispatch() goto *op->handler
+#else
+  if (slot == NULL)
+    return 0;
+#define op_case(code) case code:
+#define op_dispatch() goto dispatch
+#endif
+#define op_next(n) \
+  do { op = (n); if (--left == 0) goto done; op_dispatch(); } while (0)
+  const struct op *op = &ins->op[pc];
+  long long left = *budget;
+  if (left <= 0)
+    goto done;
+#ifdef threaded_goto
+  op_dispatch();
+#else
+dispatch:
+  switch (op->code) {
+#endif
+  op_case(op_add)
+    slot[op->rd] = add_wrap(slot[op->a], slot[op->b]);
+    op_next(op + 1);
+  op_case(op_addi)
+    slot[op->rd] = add_wrap(slot[op->a], op->b);
+    op_next(op + 1);
+  op_case(op_and)
+    slot[op->rd] = slot[op->a] & slot[op->b];
+    op_next(op + 1);
+  op_case(op_andi)
+    slot[op->rd] = slot[op->a] & op->b;
+    op_next(op + 1);
+  op_case(op_or)
+    slot[op->rd] = slot[op->a] | slot[op->b];
+    op_next(op + 1);
+  op_case(op_ori)
+    slot[op->rd] = slot[op->a] | op->b;
+    op_next(op + 1);
+  op_case(op_slt)
+    slot[op->rd] = slot[op->a] < slot[op->b];
+    op_next(op + 1);
+  op_case(op_slti)
+    slot[op->rd] = slot[op->a] < op->b;
+    op_next(op + 1);
+  op_case(op_sgti)
+    slot[op->rd] = op->b < slot[op->a];
+    op_next(op + 1);
+  op_case(op_li)
+    slot[op->rd] = op->b;
+    op_next(op + 1);
+  op_case(op_beq)
+    op_next(slot[op->a] == slot[op->b]? ins->op + op->target: op + 1);
+  op_case(op_beqi)
+    op_next(slot[op->a] == op->b? ins->op + op->target: op + 1);
+  op_case(op_bne)
+    op_next(slot[op->a] != slot[op->b]? ins->op + op->target: op + 1);
+  op_case(op_bnei)
+    op_next(slot[op->a] != op->b? ins->op + op->target: op + 1);
+  op_case(op_jump)
+    op_next(ins->op + op->target);
+  op_case(op_skip)
+    op_next(op + 1);
+  op_case(op_end)
+    goto done;
+#ifndef threaded_goto
+  }
+#endif
+#undef op_case
+#undef op_dispatch
+#undef op_next
+done:
+  *budget = left;
+  return (int)(op - ins->op);
+}
+
+int threaded_step(struct instructions *ins, int *slot, int pc) {
+  const struct op *op = &ins->op[pc];
+  switch (op->code) {
+  case op_add:  slot[op->rd] = add_wrap(slot[op->a], slot[op->b]);  return 0;
+  case op_addi: slot[op->rd] = add_wrap(slot[op->a], op->b);        return 0;
+  case op_and:  slot[op->rd] = slot[op->a] & slot[op->b];           return 0;
+  case op_andi: slot[op->rd] = slot[op->a] & op->b;                 return 0;
+  case op_or:   slot[op->rd] = slot[op->a] | slot[op->b];           return 0;
+  case op_ori:  slot[op->rd] = slot[op->a] | op->b;                 return 0;
+  case op_slt:  slot[op->rd] = slot[op->a] < slot[op->b];           return 0;
+  case op_slti: slot[op->rd] = slot[op->a] < op->b;                 return 0;
+  case op_sgti: slot[op->rd] = op->b < slot[op->a];                 return 0;
+  case op_li:   slot[op->rd] = op->b;                               return 0;
+  case op_beq:  return slot[op->a] == slot[op->b];
+  case op_beqi: return slot[op->a] == op->b;
+  case op_bne:  return slot[op->a] != slot[op->b];
+  case op_bnei: return slot[op->a] != op->b;
+  case op_jump: return 1;
+  default:      return 0;
+  }
+}
+
+int execute(struct instructions *ins, struct registers *reg, int pc) {
+  int slot[slot_count];
+  slot_load(slot, reg);
+  int taken = threaded_step(ins, slot, pc);
+  slot_store(slot, reg);
+  return taken;
+}
+
+void slot_load(int *slot, struct registers *reg) {
+  memcpy(slot, reg->t, sizeof(int) * t_max);
+  memcpy(slot + t_max, reg->s, sizeof(int) * s_max);
+  slot[slot_zero] = 0;
+  slot[slot_sink] = 0;
+}
+
+void slot_store(int *slot, struct registers *reg) {
+  memcpy(reg->t, slot, sizeof(int) * t_max);
+  memcpy(reg->s, slot + t_max, sizeof(int) * s_max);
+}
+
+int interpret(struct instructions *ins, struct registers *reg, int pc,
+  long long *budget) {
+  while (pc < ins->le_count && *budget > 0) {
+    const char *text = ins_text(ins, pc);
+    int taken = 0;
+    if (text[0] == 'b') {
+      char parsed[4][buffer_size];
+      ins_parse(text, parsed);
+      int a = reg_access(reg, parsed[1]);
+      int b = reg_access(reg, parsed[2]);
+      taken = strcmp(parsed[0], "bne") == 0? a != b: a == b;
+    } else
+      calculate(reg, text);
+    pc = taken? ins->target[pc]: pc + 1;
+    if (pc < 0)                         // a branch to no label ends it
+      pc = ins->le_count;
+    --*budget;
+  }
+  return pc;
+}
+
+double run_functional(struct instructions *ins, int mode, int runs,
+  struct registers *end, long long *count) {
+  int i;
+  struct registers init;
+  struct timespec begin, finish;
+  data_init(&init, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (i = 0, *count = 0; i < runs; ++i) {
+    long long budget = bench_budget;
+    *end = init;
+    if (mode != exec_text) {
+      int slot[slot_count];
+      slot_load(slot, end);
+      if (mode == exec_native)
+        jit_run(ins, slot, 0, &budget);
+      else
+        threaded_run(ins, slot, 0, &budget);
+      slot_store(slot, end);
+    } else
+      interpret(ins, end, 0, &budget);
+    *count += bench_budget - budget;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  return (finish.tv_sec - begin.tv_sec)
+    + (finish.tv_nsec - begin.tv_nsec) * 1e-9;
+}
+
+unsigned char *jit_bytes(unsigned char *p, const char *bytes, int n) {
+  memcpy(p, bytes, n);
+  return p + n;
+}
+
+unsigned char *jit_int(unsigned char *p, int v) {
+  memcpy(p, &v, sizeof(int));           // x86-64 is little-endian
+  return p + sizeof(int);
+}
+
+unsigned char *jit_slot(unsigned char *p, const char *bytes, int slot) {
+  // an instruction on the slot at rdi + 4 * slot
+  p = jit_bytes(p, bytes, 2);
+  return jit_int(p, slot * (int)sizeof(int));
+}
+
+int jit_compile(struct instructions *ins) {
+#if defined(__x86_64__) && defined(MAP_ANONYMOUS) && !defined(jit_none)
+  // variable declaration
+  int pc, j;
+  int n = ins->le_count;
+  int fixes = 0;
+  size_t size = ((size_t)(n + 2) * jit_op_max + 4095) & ~(size_t)4095;
+  int *leader = calloc(n + 1, sizeof(int));
+  int *fix_at = malloc(sizeof(int) * (n + 1));  // rel32 of a jump to patch
+  int *fix_pc = malloc(sizeof(int) * (n + 1));  // and the instruction of it
+  int *entry = malloc(sizeof(int) * (n + 1));
+  unsigned char *code = mmap(NULL, size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(leader != NULL && fix_at != NULL && fix_pc != NULL && entry != NULL);
+  if (code == MAP_FAILED) {
+    free(leader);
+    free(fix_at);
+    free(fix_pc);
+    free(entry);
+    return -1;
+  }
+
+  // a basic block begins at the start, at the target of a branch and after
+  // a branch
+  leader[0] = 1;
+  for (pc = 0; pc < n; ++pc)
+    if (ins->op[pc].code >= op_beq && ins->op[pc].code <= op_skip) {
+      leader[pc + 1] = 1;
+      leader[ins->op[pc].target] = 1;
+    }
+
+  // the code is called as fn(slot, &budget, entry of the first block), with
+  // the slots in rdi and the budget kept in rdx, and returns the next pc.
+  // mov rax, rdx; mov rdx, [rsi]; jmp rax
+  unsigned char *p = jit_bytes(code, "\x48\x89\xd0\x48\x8b\x16\xff\xe0", 8);
+  for (pc = 0; pc < n; ++pc) {
+    const struct op *op = &ins->op[pc];
+    entry[pc] = -1;
+    if (leader[pc]) {
+      // a block runs only if the budget covers all of it, or it returns to
+      // the interpreter, which runs the rest one by one
+      for (j = pc + 1; j < n && !leader[j]; ++j)
+        ;
+      entry[pc] = (int)(p - code);
+      p = jit_bytes(p, "\x48\x81\xfa", 3);          // cmp rdx, len
+      p = jit_int(p, j - pc);
+      p = jit_bytes(p, "\x7d\x09\x48\x89\x16\xb8", 6);// jge +9; mov [rsi], rdx
+      p = jit_int(p, pc);                           // mov eax, pc
+      p = jit_bytes(p, "\xc3\x48\x81\xea", 4);      // ret; sub rdx, len
+      p = jit_int(p, j - pc);
+    }
+    switch (op->code) {
+    case op_add: case op_and: case op_or:
+      p = jit_slot(p, "\x8b\x87", op->a);           // mov eax, [a]
+      p = jit_slot(p, op->code == op_add? "\x03\x87": op->code == op_and?
+        "\x23\x87": "\x0b\x87", op->b);             // add/and/or eax, [b]
+      p = jit_slot(p, "\x89\x87", op->rd);          // mov [rd], eax
+      break;
+    case op_addi: case op_andi: case op_ori:
+      p = jit_slot(p, "\x8b\x87", op->a);
+      p = jit_bytes(p, op->code == op_addi? "\x05": op->code == op_andi?
+        "\x25": "\x0d", 1);                         // add/and/or eax, imm
+      p = jit_int(p, op->b);
+      p = jit_slot(p, "\x89\x87", op->rd);
+      break;
+    case op_slt: case op_slti: case op_sgti:
+      p = jit_slot(p, "\x8b\x8f", op->a);           // mov ecx, [a]
+      p = jit_bytes(p, "\x31\xc0", 2);              // xor eax, eax
+      if (op->code == op_slt)
+        p = jit_slot(p, "\x3b\x8f", op->b);         // cmp ecx, [b]
+      else {
+        p = jit_bytes(p, "\x81\xf9", 2);            // cmp ecx, imm
+        p = jit_int(p, op->b);
+      }
+      p = jit_bytes(p, op->code == op_sgti? "\x0f\x9f\xc0": "\x0f\x9c\xc0",
+        3);                                         // setg/setl al
+      p = jit_slot(p, "\x89\x87", op->rd);
+      break;
+    case op_li:
+      p = jit_slot(p, "\xc7\x87", op->rd);          // mov dword [rd], imm
+      p = jit_int(p, op->b);
+      break;
+    case op_beq: case op_beqi: case op_bne: case op_bnei:
+      p = jit_slot(p, "\x8b\x87", op->a);
+      if (op->code == op_beq || op->code == op_bne)
+        p = jit_slot(p, "\x3b\x87", op->b);         // cmp eax, [b]
+      else {
+        p = jit_bytes(p, "\x3d", 1);                // cmp eax, imm
+        p = jit_int(p, op->b);
+      }
+      p = jit_bytes(p, op->code == op_beq || op->code == op_beqi?
+        "\x0f\x84": "\x0f\x85", 2);                 // je/jne target
+      fix_at[fixes] = (int)(p - code);
+      fix_pc[fixes++] = op->target;
+      p = jit_int(p, 0);
+      break;
+    case op_jump:
+      p = jit_bytes(p, "\xe9", 1);                  // jmp target
+      fix_at[fixes] = (int)(p - code);
+      fix_pc[fixes++] = op->target;
+      p = jit_int(p, 0);
+      break;
+    default:                                        // op_skip
+      break;
+    }
+  }
+  // the end of the program: mov [rsi], rdx; mov eax, n; ret
+  entry[n] = (int)(p - code);
+  p = jit_bytes(p, "\x48\x89\x16\xb8", 4);
+  p = jit_int(p, n);
+  p = jit_bytes(p, "\xc3", 1);
+  assert((size_t)(p - code) <= size);
+  for (j = 0; j < fixes; ++j)
+    jit_int(code + fix_at[j], entry[fix_pc[j]] - (fix_at[j] + 4));
+  free(leader);
+  free(fix_at);
+  free(fix_pc);
+  if (mprotect(code, size, PROT_READ | PROT_EXEC)) {
+    munmap(code, size);
+    free(entry);
+    return -1;
+  }
+  ins->jit = code;
+  ins->jit_size = size;
+  ins->jit_entry = entry;
+  return 0;
+#else
+  (void)ins;
+  return -1;
+#endif
+}
+
+int jit_run(struct instructions *ins, int *slot, int pc, long long *budget) {
+  if (ins->jit == NULL)
+    return threaded_run(ins, slot, pc, budget);
+  // interpret until a block begins, run the native code, and interpret the
+  // rest that the budget does not cover as a whole block
+  while (pc < ins->le_count && *budget > 0 && ins->jit_entry[pc] < 0) {
+    long long one = 1;
+    pc = threaded_run(ins, slot, pc, &one);
+    *budget -= 1 - one;
+  }
+  if (pc < ins->le_count && *budget > 0) {
+    int (*fn)(int *, long long *, const void *) =
+      (int (*)(int *, long long *, const void *))(void *)ins->jit;
+    pc = fn(slot, budget, ins->jit + ins->jit_entry[pc]);
+  }
+  return threaded_run(ins, slot, pc, budget);
+}
+
+void jit_free(struct instructions *ins) {
+  if (ins->jit != NULL)
+    munmap(ins->jit, ins->jit_size);
+  free(ins->jit_entry);
+  ins->jit = NULL;
+  ins->jit_entry = NULL;
+}
+
+int states_load(struct states *m, const char *path) {
+  char line[buffer_size << 2];
+  int size = 64;
+  FILE *in = fopen(path, "r");
+  if (in == NULL)
+    return -1;
+  m->count = 0;
+  m->value = malloc(sizeof(*m->value) * size);
+  assert(m->value != NULL);
+  // one state in a line, as the values of $t0 to $t9 and $s0 to $s7, and the
+  // ones not given are 0
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char *p = line, *end;
+    int k = 0;
+    while (isspace((unsigned char)*p))
+      ++p;
+    if (*p == '\0' || *p == '#')
+      continue;
+    if (m->count == size) {
+      size <<= 1;
+      m->value = realloc(m->value, sizeof(*m->value) * size);
+      assert(m->value != NULL);
+    }
+    memset(m->value[m->count], 0, sizeof(*m->value));
+    for (;;) {
+      long v = strtol(p, &end, 10);
+      if (end == p)
+        break;
+      if (k == t_max + s_max || v < INT_MIN || v > INT_MAX) {
+        free(m->value);
+        fclose(in);
+        return -1;
+      }
+      m->value[m->count][k++] = (int)v;
+      p = end;
+    }
+    while (isspace((unsigned char)*p))
+      ++p;
+    if (*p != '\0' && *p != '#') {
+      free(m->value);
+      fclose(in);
+      return -1;
+    }
+    ++m->count;
+  }
+  fclose(in);
+  if (m->count == 0)
+    free(m->value);
+  return m->count > 0? 0: -1;
+}
+
+#ifdef simd_vector
+#if defined(__x86_64__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+int simd_group(struct instructions *ins, lanes *slot, int pc,
+  long long *budget) {
+  long long left = *budget;
+  while (pc < ins->le_count && left > 0) {
+    const struct op *op = &ins->op[pc];
+    lanes taken;
+    int k, any = 0, all = 1;
+    switch (op->code) {
+    case op_add:  slot[op->rd] = slot[op->a] + slot[op->b];           break;
+    case op_addi: slot[op->rd] = slot[op->a] + op->b;                 break;
+    case op_and:  slot[op->rd] = slot[op->a] & slot[op->b];           break;
+    case op_andi: slot[op->rd] = slot[op->a] & op->b;                 break;
+    case op_or:   slot[op->rd] = slot[op->a] | slot[op->b];           break;
+    case op_ori:  slot[op->rd] = slot[op->a] | op->b;                 break;
+    // a comparison of vectors is -1 in the lanes where it holds
+    case op_slt:  slot[op->rd] = -(slot[op->a] < slot[op->b]);        break;
+    case op_slti: slot[op->rd] = -(slot[op->a] < ((lanes){} + op->b)); break;
+    case op_sgti: slot[op->rd] = -(((lanes){} + op->b) < slot[op->a]); break;
+    case op_li:   slot[op->rd] = (lanes){} + op->b;                   break;
+    case op_jump: pc = op->target;                                    --left;
+      continue;
+    case op_skip:                                                     break;
+    default:
+      // the mask of the lanes where the branch is taken
+      if (op->code == op_beq || op->code == op_bne)
+        taken = slot[op->a] == slot[op->b];
+      else
+        taken = slot[op->a] == ((lanes){} + op->b);
+      if (op->code == op_bne || op->code == op_bnei)
+        taken = ~taken;
+      for (k = 0; k < simd_width; ++k) {
+        any |= taken[k] != 0;
+        all &= taken[k] != 0;
+      }
+      if (any && !all) {                // the lanes diverge here
+        *budget = left;
+        return -1 - pc;
+      }
+      if (all) {
+        pc = op->target;
+        --left;
+        continue;
+      }
+      break;
+    }
+    ++pc;
+    --left;
+  }
+  *budget = left;
+  return pc;
+}
+#endif
+
+int simd_run(struct instructions *ins, struct states *m, int first,
+  long long budget, long long executed[], int end[]) {
+  int i, k;
+  int n = m->count - first < simd_width? m->count - first: simd_width;
+  int diverged = 0;
+  long long left = budget;
+  int pc = 0;
+#ifdef simd_vector
+  // the states are put in the lanes of the slots, and the lanes left over
+  // repeat the first state so that they never diverge from it
+  lanes slot[slot_count];
+  memset(slot, 0, sizeof(slot));
+  for (k = 0; k < simd_width; ++k)
+    for (i = 0; i < t_max + s_max; ++i)
+      slot[i][k] = m->value[first + (k < n? k: 0)][i];
+  pc = simd_group(ins, slot, 0, &left);
+  for (k = 0; k < n; ++k)
+    for (i = 0; i < t_max + s_max; ++i)
+      m->value[first + k][i] = slot[i][k];
+  if (pc < 0) {
+    pc = -1 - pc;
+    diverged = 1;
+  }
+#else
+  diverged = 1;                         // every lane runs alone
+#endif
+  for (k = 0; k < n; ++k) {
+    long long rest = left;
+    int at = pc;
+    if (diverged) {
+      int one[slot_count];
+      memcpy(one, m->value[first + k], sizeof(int) * (t_max + s_max));
+      one[slot_zero] = 0;
+      one[slot_sink] = 0;
+      at = jit_run(ins, one, pc, &rest);
+      memcpy(m->value[first + k], one, sizeof(int) * (t_max + s_max));
+    }
+    executed[first + k] = budget - rest;
+    end[first + k] = at >= ins->le_count;
+  }
+  return diverged;
+}
+
+void print_states(struct states *m, long long executed[], int end[],
+  int groups, int diverged) {
+  int i, k;
+  char name[buffer_size];
+  printf("%-8s%-14s%-6s", "state", "instructions", "end");
+  for (i = 0; i < t_max + s_max; ++i) {
+    snprintf(name, sizeof(name), "$%c%d", i < t_max? 't': 's',
+      i < t_max? i: i - t_max);
+    printf(" %s", name);
+  }
+  printf("\n");
+  for (k = 0; k < m->count; ++k) {
+    printf("%-8d%-14lld%-6s", k, executed[k], end[k]? "yes": "cut");
+    for (i = 0; i < t_max + s_max; ++i)
+      printf(" %d", m->value[k][i]);
+    printf("\n");
+  }
+  printf("NOTE: %d of %d groups of %d lanes diverged and ran lane by lane\n",
+    diverged, groups, simd_width);
+}
+
+void states_bench(struct instructions *ins, struct states *m,
+  long long budget, int runs) {
+  int i, k, r;
+  long long count = 0;
+  long long *executed = malloc(sizeof(long long) * m->count);
+  int *end = malloc(sizeof(int) * m->count);
+  struct states copy;
+  double scalar, vector;
+  struct timespec begin, finish;
+  char buffer[buffer_size];
+  memset(buffer, '-', 82);
+  buffer[82] = '\0';
+  assert(executed != NULL && end != NULL);
+  copy.count = m->count;
+  copy.value = malloc(sizeof(*m->value) * m->count);
+  assert(copy.value != NULL);
+  // one state at a time by the threaded code
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (r = 0; r < runs; ++r)
+    for (k = 0; k < m->count; ++k) {
+      int one[slot_count];
+      long long rest = budget;
+      memcpy(one, m->value[k], sizeof(int) * (t_max + s_max));
+      one[slot_zero] = 0;
+      one[slot_sink] = 0;
+      threaded_run(ins, one, 0, &rest);
+      count += budget - rest;
+      memcpy(copy.value[k], one, sizeof(int) * (t_max + s_max));
+    }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  scalar = (finish.tv_sec - begin.tv_sec)
+    + (finish.tv_nsec - begin.tv_nsec) * 1e-9;
+  // the states in the lanes of vectors
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (r = 0; r < runs; ++r) {
+    struct states lane;
+    lane.count = m->count;
+    lane.value = malloc(sizeof(*m->value) * m->count);
+    assert(lane.value != NULL);
+    memcpy(lane.value, m->value, sizeof(*m->value) * m->count);
+    for (i = 0; i < m->count; i += simd_width)
+      simd_run(ins, &lane, i, budget, executed, end);
+    if (r == runs - 1)
+      assert(memcmp(lane.value, copy.value,
+        sizeof(*m->value) * m->count) == 0);
+    free(lane.value);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  vector = (finish.tv_sec - begin.tv_sec)
+    + (finish.tv_nsec - begin.tv_nsec) * 1e-9;
+  printf("%s\n", buffer);
+  printf("MULTI-INSTANCE EXECUTION, %d runs of %d states, %lld instructions\n",
+    runs, m->count, count);
+  printf("%-14s%-12s%s\n", "execution", "seconds", "ns/instruction");
+  printf("%-14s%-12.3f%.2f\n", "one by one", scalar,
+    scalar * 1e9 / (count? count: 1));
+  printf("%-14s%-12.3f%.2f\n", "lanes", vector,
+    vector * 1e9 / (count? count: 1));
+  printf("speedup: %.2fx with %d lanes\n", vector > 0? scalar / vector: 0.0,
+    simd_width);
+  free(copy.value);
+  free(executed);
+  free(end);
+}
+
+int result_key(struct instructions ins[], struct config *cfg,
+  unsigned long long *key) {
+  int i, j, k, fd;
+  ssize_t n;
+  unsigned char buffer[buffer_size * 64];
+  int option[7];
+  unsigned long long hash = 14695981039346656037ULL;
+  // the executable stands for the version of the simulator
+  fd = open("/proc/self/exe", O_RDONLY);
+  if (fd < 0)
+    return -1;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    for (k = 0; k < n; ++k)             // FNV-1a
+      hash = (hash ^ buffer[k]) * 1099511628211ULL;
+  close(fd);
+  if (n < 0)
+    return -1;
+  // the options which change what is printed
+  option[0] = cfg->forwarding;
+  option[1] = cfg->policy;
+  option[2] = cfg->limit;
+  option[3] = cfg->summary;
+  option[4] = cfg->verbose;
+  option[5] = cfg->threads;
+  option[6] = cfg->journal;
+  for (k = 0; k < (int)sizeof(option); ++k)
+    hash = (hash ^ ((unsigned char *)option)[k]) * 1099511628211ULL;
+  // the tokens of every line, so that comments, spaces, commas and line
+  // endings do not matter
+  for (i = 0; i < cfg->threads; ++i) {
+    hash = (hash ^ (unsigned)ins[i].o_count) * 1099511628211ULL;
+    for (j = 0; j < ins[i].o_count; ++j) {
+      struct line *ln = &ins[i].o_ins[j];
+      hash = (hash ^ (unsigned)ln->label) * 1099511628211ULL;
+      for (k = 0; k < 4; ++k) {
+        const char *t = ins[i].text + ln->t[k].off;
+        int m;
+        hash = (hash ^ (unsigned)ln->t[k].len) * 1099511628211ULL;
+        for (m = 0; m < ln->t[k].len; ++m)
+          hash = (hash ^ (unsigned char)t[m]) * 1099511628211ULL;
+      }
+    }
+  }
+  *key = hash;
+  return 0;
+}
+
+int result_load(struct results *rs, struct registers reg[],
+  struct instructions ins[], struct config *cfg) {
+  int i;
+  char path[buffer_size * 8];
+  char buffer[buffer_size * 64];
+  struct result_head h;
+  struct stat sb;
+  long long left;
+  FILE *in;
+  snprintf(path, sizeof(path), "%s/%016llx%s", rs->dir, rs->key,
+    result_suffix);
+  in = fopen(path, "rb");
+  if (in == NULL)
+    return -1;
+  // a result cut by a full disk is not used
+  if (fstat(fileno(in), &sb) || fread(&h, sizeof(h), 1, in) != 1
+    || memcmp(h.magic, "P1RC", 4) || h.key != rs->key
+    || sb.st_size != (off_t)(sizeof(h) + h.output)) {
+    fclose(in);
+    return -1;
+  }
+  if (h.rebuilt) {
+    for (i = 0; i < cfg->threads; ++i) {
+      memcpy(reg[i].t, h.value[i], sizeof(reg[i].t));
+      memcpy(reg[i].s, h.value[i] + t_max, sizeof(reg[i].s));
+    }
+    print_summary(reg, cfg, &h.st);
+    print_livelock(ins, cfg, &h.st);
+  }
+  for (left = h.output; left > 0; ) {
+    size_t n = fread(buffer, 1, left < (long long)sizeof(buffer)?
+      (size_t)left: sizeof(buffer), in);
+    if (n == 0)
+      break;
+    fwrite(buffer, 1, n, stdout);
+    left -= n;
+  }
+  fclose(in);
+  utimensat(AT_FDCWD, path, NULL, 0);   // used now, for the LRU
+  return h.status;
+}
+
+int result_begin(struct results *rs, struct config *cfg) {
+  struct result_head h;
+  // the result is written aside, and moved into the cache once complete
+  mkdir(rs->dir, 0777);
+  snprintf(rs->path, sizeof(rs->path), "%s/%016llx%s.%ld", rs->dir, rs->key,
+    result_suffix, (long)getpid());
+  rs->out = fopen(rs->path, "w+b");
+  if (rs->out == NULL)
+    return -1;
+  memset(&h, 0, sizeof(h));
+  fwrite(&h, sizeof(h), 1, rs->out);
+  // the summary of a program can be rebuilt, the tables and the report of
+  // several threads are kept
+  if (!cfg->summary || cfg->threads > 1)
+    cfg->report = rs->out;
+  return 0;
+}
+
+void result_end(struct results *rs, struct registers reg[],
+  struct config *cfg, struct stats *st, int status) {
+  int i, ok;
+  char path[buffer_size * 8];
+  char buffer[buffer_size * 64];
+  struct result_head h;
+  size_t n;
+  // the entry is only read by the same executable, as it is in the key, so
+  // the head is written as it is in memory
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, "P1RC", 4);
+  h.key = rs->key;
+  h.status = status;
+  h.rebuilt = cfg->report != rs->out;
+  h.st = *st;
+  for (i = 0; i < cfg->threads; ++i) {
+    memcpy(h.value[i], reg[i].t, sizeof(reg[i].t));
+    memcpy(h.value[i] + t_max, reg[i].s, sizeof(reg[i].s));
+  }
+  fflush(rs->out);
+  h.output = h.rebuilt? 0: ftell(rs->out) - (long)sizeof(h);
+  // print the output kept in the result
+  if (!h.rebuilt) {
+    fseek(rs->out, sizeof(h), SEEK_SET);
+    while ((n = fread(buffer, 1, sizeof(buffer), rs->out)) > 0)
+      fwrite(buffer, 1, n, stdout);
+  }
+  cfg->report = stdout;
+  fseek(rs->out, 0, SEEK_SET);
+  ok = fwrite(&h, sizeof(h), 1, rs->out) == 1;
+  ok = fclose(rs->out) == 0 && ok;
+  rs->out = NULL;
+  snprintf(path, sizeof(path), "%s/%016llx%s", rs->dir, rs->key,
+    result_suffix);
+  if (!ok || rename(rs->path, path)) {
+    unlink(rs->path);
+    return;
+  }
+  result_evict(rs);
+}
+
+void result_evict(struct results *rs) {
+  int i;
+  int count = 0, size = 0;
+  long long total = 0;
+  size_t len = strlen(result_suffix);
+  char path[buffer_size * 8];
+  struct result_file *file = NULL;
+  struct dirent *e;
+  struct stat sb;
+  DIR *dir = opendir(rs->dir);
+  if (dir == NULL)
+    return;
+  while ((e = readdir(dir)) != NULL) {
+    size_t n = strlen(e->d_name);
+    if (n < len || n >= buffer_size
+      || strcmp(e->d_name + n - len, result_suffix))
+      continue;                         // not a result, or being written
+    snprintf(path, sizeof(path), "%s/%s", rs->dir, e->d_name);
+    if (stat(path, &sb))
+      continue;
+    if (count == size) {
+      size = size? size << 1: 64;
+      file = realloc(file, sizeof(struct result_file) * size);
+      assert(file != NULL);
+    }
+    file[count].used = sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+    file[count].size = sb.st_size;
+    strcpy(file[count].name, e->d_name);
+    total += sb.st_size;
+    ++count;
+  }
+  closedir(dir);
+  if (total > rs->bound) {
+    qsort(file, count, sizeof(struct result_file), result_compare);
+    for (i = 0; i < count && total > rs->bound; ++i) {
+      snprintf(path, sizeof(path), "%s/%s", rs->dir, file[i].name);
+      if (unlink(path) == 0)
+        total -= file[i].size;
+    }
+  }
+  free(file);
+}
+
+int result_compare(const void *a, const void *b) {
+  const struct result_file *x = a, *y = b;
+  return x->used < y->used? -1: x->used > y->used;
+}
+
+int run_daemon(const char *path) {
+  int i, n, fd, workers;
+  struct sockaddr_un addr;
+  struct daemon *d;
+  pthread_t thread;
+  struct pollfd fds[daemon_clients + 2];
+  struct client *polled[daemon_clients];
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ERROR: the path of the socket is too long.\n");
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, path);
+  signal(SIGPIPE, SIG_IGN);             // a client leaving ends no worker
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);                         // left by a daemon before
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+    || listen(fd, daemon_clients) < 0) {
+    fprintf(stderr, "ERROR: cannot listen on %s.\n", path);
+    return EXIT_FAILURE;
+  }
+  d = calloc(1, sizeof(struct daemon));
+  if (d == NULL || pipe(d->wake) < 0) {
+    fprintf(stderr, "ERROR: cannot start the workers.\n");
+    return EXIT_FAILURE;
+  }
+  fcntl(d->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(d->wake[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->ready, NULL);
+  workers = chunk_count((size_t)-1);   // one worker for every core
+  for (i = 0; i < workers; ++i) {
+    if (pthread_create(&thread, NULL, daemon_worker, d) != 0)
+      break;
+    pthread_detach(thread);
+  }
+  if (i == 0) {
+    fprintf(stderr, "ERROR: cannot start the workers.\n");
+    return EXIT_FAILURE;
+  }
+  printf("listening on %s with %d workers\n", path, i);
+  fflush(stdout);
+
+  // a connection is either idle here, waiting in the queue, or served by a
+  // worker, so no worker waits for a client which sends nothing
+  for (;;) {
+    pthread_mutex_lock(&d->lock);
+    n = d->idle_count;
+    for (i = 0; i < n; ++i) {
+      polled[i] = d->idle[i];
+      fds[i + 2].fd = d->idle[i]->fd;
+      fds[i + 2].events = POLLIN;
+    }
+    pthread_mutex_unlock(&d->lock);
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = d->wake[0];             // a connection is idle again
+    fds[1].events = POLLIN;
+    if (poll(fds, n + 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "ERROR: cannot poll the connections.\n");
+      return EXIT_FAILURE;
+    }
+    if (fds[1].revents) {
+      char drain[buffer_size];
+      while (read(d->wake[0], drain, sizeof(drain)) > 0)
+        ;
+    }
+    // the connections with a request, or closed, go to the workers
+    pthread_mutex_lock(&d->lock);
+    for (i = 0; i < n; ++i)
+      if (fds[i + 2].revents) {
+        int k;
+        for (k = 0; d->idle[k] != polled[i]; ++k)
+          ;
+        d->idle[k] = d->idle[--d->idle_count];
+        d->queue[(d->head + d->count++) % daemon_clients] = polled[i];
+        pthread_cond_signal(&d->ready);
+      }
+    pthread_mutex_unlock(&d->lock);
+    if (fds[0].revents & POLLIN) {
+      int c = accept(fd, NULL, NULL);
+      if (c < 0)
+        continue;
+      pthread_mutex_lock(&d->lock);
+      struct client *cl = NULL;
+      if (d->clients < daemon_clients   // or too many connections
+        && (cl = calloc(1, sizeof(struct client))) == NULL)
+        daemon_error(c, "ERROR: out of memory.\n");
+      if (cl == NULL)
+        close(c);
+      else {
+        cl->fd = c;
+        d->idle[d->idle_count++] = cl;
+        ++d->clients;
+      }
+      pthread_mutex_unlock(&d->lock);
+    }
+  }
+}
+
+void *daemon_worker(void *arg) {
+  struct daemon *d = arg;
+  for (;;) {
+    struct client *c;
+    int closed;
+    pthread_mutex_lock(&d->lock);
+    while (d->count == 0)
+      pthread_cond_wait(&d->ready, &d->lock);
+    c = d->queue[d->head];
+    d->head = (d->head + 1) % daemon_clients;
+    --d->count;
+    pthread_mutex_unlock(&d->lock);
+    closed = daemon_job(d, c);
+    pthread_mutex_lock(&d->lock);
+    if (closed) {
+      close(c->fd);
+      free(c);
+      --d->clients;
+    } else if (c->have) {               // the next request is read already
+      d->queue[(d->head + d->count++) % daemon_clients] = c;
+      pthread_cond_signal(&d->ready);
+    } else {
+      d->idle[d->idle_count++] = c;
+      // a full pipe has enough wakes already, so a failed write is fine
+      if (write(d->wake[1], "", 1) < 0)
+        errno = 0;
+    }
+    pthread_mutex_unlock(&d->lock);
+  }
+  return NULL;
+}
+
+int daemon_job(struct daemon *d, struct client *c) {
+  // variable declaration
+  char line[buffer_size];
+  char *arg[8], *p, *save, *end;
+  int n, i, err;
+  int status = EXIT_SUCCESS;
+  long size;
+  char *text, *result = NULL;
+  size_t result_size = 0;
+  struct config cfg;
+  struct registers reg;
+  struct stats st;
+  struct cached *cp;
+  FILE *report;
+
+  // a request is a line like "F -n -l 1000 <bytes>" and the bytes of the
+  // program, the options are the ones of the command line
+  if (daemon_line(c, line))
+    return -1;
+  for (n = 0, p = strtok_r(line, " \t\r", &save); p != NULL && n < 8;
+    p = strtok_r(NULL, " \t\r", &save))
+    arg[n++] = p;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.threads = 1;
+  cfg.policy = policy_rr;
+  cfg.verbose = 1;
+  cfg.limit = cycle_max;
+  size = n >= 2? strtol(arg[n - 1], &end, 10): -1;
+  err = p != NULL || n < 2 || *end != '\0' || size < 0
+    || size > daemon_text_max
+    || (strcmp(arg[0], "F") && strcmp(arg[0], "N"));
+  cfg.forwarding = n >= 1 && strcmp(arg[0], "F") == 0? 1: 0;
+  for (i = 1; !err && i < n - 1; ++i) {
+    if (strcmp(arg[i], "-n") == 0) {
+      cfg.summary = 1;                  // only print a summary, so loops
+      cfg.verbose = 0;                  // can be fast-forwarded
+    } else if (strcmp(arg[i], "-l") == 0 && i + 1 < n - 1) {
+      long limit = strtol(arg[++i], &end, 10);
+      err = *arg[i] == '\0' || *end != '\0' || limit < 0 || limit > 0x7fffffff;
+      cfg.limit = (int)limit;
+    } else
+      err = 1;
+  }
+  if (err) {                            // the rest cannot be framed
+    daemon_error(c->fd, "ERROR: invalid request.\n");
+    return -1;
+  }
+  text = malloc(size > 0? size: 1);
+  if (text == NULL) {                   // nor can it be read
+    daemon_error(c->fd, "ERROR: out of memory.\n");
+    return -1;
+  }
+  if (daemon_read(c, text, size)) {
+    free(text);
+    return -1;
+  }
+
+  // run the program, which is decoded once for all the requests
+  report = open_memstream(&result, &result_size);
+  if (report == NULL) {
+    free(text);
+    return daemon_error(c->fd, "ERROR: out of memory.\n");
+  }
+  cp = daemon_program(d, text, size, report);
+  free(text);
+  if (cp == NULL)
+    status = EXIT_FAILURE;
+  else {
+    cfg.report = report;
+    data_init(&reg, NULL);
+    if (pipeline(&reg, &cp->ins, &cfg, &st)) {
+      fprintf(report, "ERROR: out of memory or threads.\n");
+      status = EXIT_FAILURE;
+    } else {
+      if (cfg.summary)
+        print_summary(&reg, &cfg, &st);
+      status = print_livelock(&cp->ins, &cfg, &st)? livelock_status:
+        EXIT_SUCCESS;
+    }
+    daemon_release(d, cp);
+  }
+  // the output is lost if the stream cannot grow
+  err = ferror(report);
+  if (fclose(report) != 0 || err || result == NULL) {
+    free(result);
+    return daemon_error(c->fd, "ERROR: out of memory.\n");
+  }
+
+  // the response is the exit status, the count of bytes and the output
+  snprintf(line, sizeof(line), "%d %lu\n", status, (unsigned long)result_size);
+  err = daemon_write(c->fd, line, strlen(line))
+    || daemon_write(c->fd, result, result_size);
+  free(result);
+  return err? -1: 0;
+}
+
+int daemon_line(struct client *c, char *line) {
+  char *nl;
+  int len;
+  while ((nl = memchr(c->ahead, '\n', c->have)) == NULL) {
+    ssize_t n;
+    if (c->have == buffer_size)         // too long for a request
+      return -1;
+    n = read(c->fd, c->ahead + c->have, buffer_size - c->have);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    c->have += n;
+  }
+  len = nl - c->ahead;
+  memcpy(line, c->ahead, len);
+  line[len] = '\0';
+  c->have -= len + 1;
+  memmove(c->ahead, nl + 1, c->have);
+  return 0;
+}
+
+int daemon_read(struct client *c, char *buffer, long size) {
+  long done = c->have < size? c->have: size;
+  memcpy(buffer, c->ahead, done);
+  c->have -= done;
+  memmove(c->ahead, c->ahead + done, c->have);
+  while (done < size) {
+    ssize_t n = read(c->fd, buffer + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    done += n;
+  }
+  return 0;
+}
+
+int daemon_error(int fd, const char *error) {
+  char line[buffer_size];
+  snprintf(line, sizeof(line), "%d %lu\n%s", EXIT_FAILURE,
+    (unsigned long)strlen(error), error);
+  return daemon_write(fd, line, strlen(line));
+}
+
+int daemon_write(int fd, const char *buffer, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, buffer, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buffer += n;
+    size -= n;
+  }
+  return 0;
+}
+
+struct cached *daemon_program(struct daemon *d, const char *text, long size,
+  FILE *report) {
+  int i, err, free_slot = -1;
+  long k;
+  unsigned long long hash = 14695981039346656037ULL;
+  struct cached *c = NULL;
+  for (k = 0; k < size; ++k)            // FNV-1a
+    hash = (hash ^ (unsigned char)text[k]) * 1099511628211ULL;
+  pthread_mutex_lock(&d->lock);
+  for (i = 0; i < daemon_cache && c == NULL; ++i)
+    if (d->cache[i] && d->cache[i]->hash == hash
+      && (long)d->cache[i]->ins.size == size
+      && memcmp(d->cache[i]->ins.text, text, size) == 0)
+      c = d->cache[i];
+  if (c) {
+    ++c->refs;
+    c->used = ++d->clock;
+    pthread_mutex_unlock(&d->lock);
+    return c;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  // decode it without the lock, as other jobs go on. the program is empty as
+  // after data_init()
+  c = calloc(1, sizeof(struct cached));
+  if (c == NULL) {
+    fprintf(report, "ERROR: out of memory.\n");
+    return NULL;
+  }
+  c->hash = hash;
+  c->refs = 1;
+  err = load_text(text, size, &c->ins);
+  if (err == -1)
+    fprintf(report, "ERROR: out of memory.\n");
+  else if (err > 0)
+    fprintf(report, "ERROR: invalid instruction at line %d.\n", err);
+  else {
+    err = label_preprocess(&c->ins);
+    // a taken branch to no label would stop the pipeline of every job
+    if (err == 0 && (err = label_check(&c->ins)) > 0)
+      fprintf(report, "ERROR: undefined label at line %d.\n", err);
+    else if (err == 0)
+      err = threaded_lower(&c->ins);
+    if (err == -1)
+      fprintf(report, "ERROR: out of memory.\n");
+  }
+  if (err) {
+    program_free(&c->ins);
+    free(c);
+    return NULL;
+  }
+
+  // keep it in a free slot, or in place of the least recently used program
+  // that no job is running
+  pthread_mutex_lock(&d->lock);
+  c->used = ++d->clock;
+  for (i = 0; i < daemon_cache; ++i)
+    if (d->cache[i] == NULL) {
+      free_slot = i;
+      break;
+    } else if (d->cache[i]->refs == 0 && (free_slot == -1
+      || d->cache[i]->used < d->cache[free_slot]->used))
+      free_slot = i;
+  if (free_slot != -1) {
+    struct cached *old = d->cache[free_slot];
+    if (old) {
+      program_free(&old->ins);
+      free(old);
+    }
+    d->cache[free_slot] = c;
+    c->kept = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return c;
+}
+
+void daemon_release(struct daemon *d, struct cached *c) {
+  int gone;
+  pthread_mutex_lock(&d->lock);
+  gone = --c->refs == 0 && !c->kept;
+  pthread_mutex_unlock(&d->lock);
+  if (gone) {
+    program_free(&c->ins);
+    free(c);
+  }
+}
+
+int run_watch(const char *path, struct instructions *ins, struct config *cfg) {
+  struct watch w;
+  struct stat seen;                     // the file at the last check
+  struct timespec nap = {watch_poll / 1000, watch_poll % 1000 * 1000000L};
+  int i, err;
+  memset(&w, 0, sizeof(w));
+  w.path = path;
+  w.ins = *ins;
+  w.cfg = cfg;
+  if (stat(path, &w.sb) < 0) {
+    fprintf(stderr, "ERROR: cannot open file.\n");
+    return EXIT_FAILURE;
+  }
+  seen = w.sb;
+  w.touch = malloc(sizeof(int) * (w.ins.le_count + 1));
+  assert(w.touch != NULL);
+  if (watch_simulate(&w, -1)) {
+    fprintf(stderr, "ERROR: out of memory or threads.\n");
+    return EXIT_FAILURE;
+  }
+  if (cfg->summary)
+    print_summary(&w.reg, cfg, &w.st);
+  print_livelock(&w.ins, cfg, &w.st);
+  fflush(cfg->report);
+
+  for (;;) {
+    struct stat sb;
+    struct instructions next;
+    struct timespec begin, end;
+    int pos, cutoff = INT_MAX, from, cycles = w.st.cycles;
+    nanosleep(&nap, NULL);
+    if (stat(path, &sb) < 0 || watch_same(&sb, &w.sb))
+      continue;
+    // an editor may write the file in several steps, so it is loaded once it
+    // stays the same for one check
+    if (!watch_same(&sb, &seen)) {
+      seen = sb;
+      continue;
+    }
+    w.sb = sb;
+    // the program stays as it is until the file is valid again
+    memset(&next, 0, sizeof(next));
+    err = load_program(path, &next);
+    if (err == -1)
+      fprintf(stderr, "ERROR: cannot open file.\n");
+    else if (err == -2)
+      fprintf(stderr, "ERROR: out of memory.\n");
+    else if (err > 0)
+      fprintf(stderr, "ERROR: invalid instruction at line %d.\n", err);
+    else {
+      err = label_preprocess(&next);
+      if (err == 0 && (err = label_check(&next)) > 0)
+        fprintf(stderr, "ERROR: undefined label at line %d.\n", err);
+      else if (err == 0)
+        err = threaded_lower(&next);
+      if (err == -1)
+        fprintf(stderr, "ERROR: out of memory.\n");
+    }
+    if (err) {
+      program_free(&next);
+      continue;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    // the run stays the same until a position from the change on is checked
+    // for an instruction, as the instructions before it and their targets
+    // are the same
+    pos = watch_change(&w.ins, &next);
+    for (i = pos; pos >= 0 && i <= w.ins.le_count; ++i)
+      if (w.touch[i] < cutoff)
+        cutoff = w.touch[i];
+    program_free(&w.ins);
+    w.ins = next;
+    w.touch = realloc(w.touch, sizeof(int) * (w.ins.le_count + 1));
+    assert(w.touch != NULL);
+    for (i = pos; pos >= 0 && i <= w.ins.le_count; ++i)
+      w.touch[i] = INT_MAX;
+    if (pos == -1) {
+      fprintf(cfg->report, "WATCH: %s changed, but not its instructions\n",
+        path);
+      fflush(cfg->report);
+      continue;
+    }
+    if (pos < w.ins.le_count)
+      fprintf(cfg->report, "WATCH: %s changed at line %d", path,
+        w.ins.o_ins[w.ins.le_ins[pos]].number);
+    else
+      fprintf(cfg->report, "WATCH: %s changed after its last instruction",
+        path);
+    if (cutoff == INT_MAX) {
+      fprintf(cfg->report, ", which the run does not reach\n");
+      fflush(cfg->report);
+      continue;
+    }
+    // the state of the checkpoint is the one after its cycles, so a change
+    // checked in the first cycle after it is in time
+    from = cutoff == 0? -1: (cutoff - 1) / watch_period;
+    if (from >= w.cp_count)
+      from = w.cp_count - 1;
+    fprintf(cfg->report, ", simulated again from cycle %d\n",
+      from == -1? 0: from * watch_period);
+    if (watch_simulate(&w, from)) {
+      fprintf(stderr, "ERROR: out of memory or threads.\n");
+      return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (cfg->summary)
+      print_summary(&w.reg, cfg, &w.st);
+    print_livelock(&w.ins, cfg, &w.st);
+    fprintf(cfg->report, "WATCH: %d cycles (%+d), %d simulated in %.2f ms\n",
+      w.st.cycles, w.st.cycles - cycles,
+      w.st.cycles - (from == -1? 0: from * watch_period),
+      (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6);
+    fflush(cfg->report);
+  }
+}
+
+int watch_simulate(struct watch *w, int from) {
+  struct config *cfg = w->cfg;
+  struct machine *m = &w->m;
+  int i, cycle, ended = 0;
+  if (from == -1) {
+    // nothing but the start and the end is printed by the machine, and no
+    // loop is fast-forwarded, as a checkpoint cannot hold the log of it
+    data_init(&w->reg, NULL);
+    if (machine_begin(m, &w->reg, &w->ins, cfg, &w->st, source_execute,
+      output_print))
+      return -1;
+    for (i = 0; i <= w->ins.le_count; ++i)
+      w->touch[i] = INT_MAX;
+    w->touch[0] = 0;                    // checked by machine_begin()
+    w->cp_count = 0;
+  } else {
+    struct checkpoint *cp = &w->cp[from];
+    *m = cp->m;
+    w->reg = cp->reg;
+    w->st = cp->st;
+    // the instructions in the window come before the change, at the same
+    // positions, but their text is in the pool of the program loaded now
+    for (i = 0; i < m->wk.w_count; ++i)
+      if (m->wk.w_ins[i] != nop_handle)
+        m->wk.w_ins[i] = w->ins.le_text[m->wk.w_pc[i]];
+    for (i = 0; i <= w->ins.le_count; ++i)
+      if (w->touch[i] > from * watch_period)
+        w->touch[i] = INT_MAX;
+    w->cp_count = from + 1;
+    m->wr = cfg->verbose? writer_start(cfg, &w->ins, source_execute): NULL;
+    if (cfg->verbose && m->wr == NULL)
+      return -1;
+  }
+  m->touch = w->touch;
+
+  cycle = m->wk.base + m->time;
+  while (!ended && (cfg->limit == 0 || cycle < cfg->limit)) {
+    if (cycle == w->cp_count * watch_period) {
+      if (w->cp_count == w->cp_size) {
+        w->cp_size = w->cp_size? w->cp_size << 1: 16;
+        w->cp = realloc(w->cp, sizeof(struct checkpoint) * w->cp_size);
+        assert(w->cp != NULL);
+      }
+      w->cp[w->cp_count].m = *m;
+      w->cp[w->cp_count].reg = w->reg;
+      w->cp[w->cp_count++].st = w->st;
+    }
+    ended = machine_step(m);
+    cycle = m->wk.base + m->time;
+    if (cfg->verbose) {
+      unsigned long long hash = watch_frame(w);
+      if (cycle > w->frame_size) {
+        w->frame_size = w->frame_size? w->frame_size << 1: 1024;
+        w->frame = realloc(w->frame,
+          sizeof(unsigned long long) * w->frame_size);
+        assert(w->frame != NULL);
+      }
+      if (cycle > w->frame_count || w->frame[cycle - 1] != hash)
+        writer_frame(m->wr, &m->wk, m->w_table, &w->reg, m->time);
+      w->frame[cycle - 1] = hash;
+    }
+  }
+  w->frame_count = cycle;
+  machine_end(m, output_print);
+  return 0;
+}
+
+unsigned long long watch_frame(struct watch *w) {
+  int i, j;
+  unsigned long long hash = 14695981039346656037ULL;
+  struct working *wk = &w->m.wk;
+  const char *text;
+  // FNV-1a of the rows of the table and the registers
+  hash = (hash ^ (unsigned)wk->w_count) * 1099511628211ULL;
+  for (i = 0; i < wk->w_count; ++i) {
+    for (text = w_text(wk, i); *text; ++text)
+      hash = (hash ^ (unsigned char)*text) * 1099511628211ULL;
+    for (j = 1; j <= cycle_max; ++j)
+      hash = (hash ^ (unsigned)w->m.w_table[i][j]) * 1099511628211ULL;
+  }
+  for (i = 0; i < t_max; ++i)
+    hash = (hash ^ (unsigned)w->reg.t[i]) * 1099511628211ULL;
+  for (i = 0; i < s_max; ++i)
+    hash = (hash ^ (unsigned)w->reg.s[i]) * 1099511628211ULL;
+  return hash;
+}
+
+int watch_same(const struct stat *a, const struct stat *b) {
+  return a->st_ino == b->st_ino && a->st_size == b->st_size
+    && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+    && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+int watch_change(struct instructions *old, struct instructions *ins) {
+  int i;
+  int n = old->le_count < ins->le_count? old->le_count: ins->le_count;
+  for (i = 0; i < n; ++i)
+    if (strcmp(ins_text(old, i), ins_text(ins, i))
+      || old->target[i] != ins->target[i])
+      return i;
+  return old->le_count == ins->le_count? -1: n;
+}
+
+int golden_open(struct golden *g, const char *path) {
+  memset(g, 0, sizeof(*g));
+  g->stages = 14695981039346656037ULL;  // FNV-1a
+  g->regs = 14695981039346656037ULL;
+  g->out = fopen(path, "wb");
+  return g->out == NULL? -1: 0;
+}
+
+void golden_cycle(struct golden *g, struct working *wk,
+  int w_table[cycle_max << 2][cycle_max + 1], struct registers reg[],
+  int time) {
+  int i, j, n = 0;
+  unsigned hash;
+  // the rows in a stage by their thread, position and stage, and all the
+  // registers, so the hashes after a cycle stand for every cycle before
+  for (i = 0; i < wk->w_count; ++i)
+    if (w_table[i][time] != 0) {
+      g->stages = (g->stages ^ (unsigned)wk->w_tid[i]) * 1099511628211ULL;
+      g->stages = (g->stages ^ (unsigned)wk->w_pc[i]) * 1099511628211ULL;
+      g->stages = (g->stages ^ (unsigned)w_table[i][time]) * 1099511628211ULL;
+      ++n;
+    }
+  g->stages = (g->stages ^ (unsigned)n) * 1099511628211ULL;
+  for (i = 0; i < wk->threads; ++i)
+    for (j = 0; j < t_max + s_max; ++j)
+      g->regs = (g->regs ^ (unsigned)(j < t_max? reg[i].t[j]:
+        reg[i].s[j - t_max])) * 1099511628211ULL;
+  hash = (unsigned)(g->stages >> 48) << 16 | (unsigned)(g->regs >> 48);
+  ++g->cycles;
+  if (g->out) {
+    if (g->count == g->size) {
+      g->size = g->size? g->size << 1: 1024;
+      g->hash = realloc(g->hash, sizeof(unsigned) * g->size);
+      assert(g->hash != NULL);
+    }
+    g->hash[g->count++] = hash;
+  } else if (!g->diverged
+    && (g->cycles > g->count || g->hash[g->cycles - 1] != hash)) {
+    // the golden run has only hashes, so what this run has in the cycle is
+    // kept to be printed
+    FILE *f = open_memstream(&g->focus, &g->focus_size);
+    assert(f != NULL);
+    g->diverged = g->cycles;
+    if (g->cycles > g->count)
+      g->part = golden_end;
+    else {
+      if ((hash ^ g->hash[g->cycles - 1]) >> 16)
+        g->part |= golden_stages;
+      if ((hash ^ g->hash[g->cycles - 1]) & 0xffff)
+        g->part |= golden_regs;
+    }
+    for (i = 0; i < wk->w_count; ++i)
+      if (w_table[i][time] != 0) {
+        char tagged[buffer_size + 8];
+        if (wk->threads > 1)
+          snprintf(tagged, sizeof(tagged), "%d:%s", wk->w_tid[i],
+            w_text(wk, i));
+        else
+          snprintf(tagged, sizeof(tagged), "%s", w_text(wk, i));
+        fprintf(f, "    %-20s%s\n", tagged, stage_name[w_table[i][time]]);
+      }
+    for (i = 0, n = 0; i < wk->threads; ++i)
+      for (j = 0; j < t_max + s_max; ++j) {
+        int v = j < t_max? reg[i].t[j]: reg[i].s[j - t_max];
+        if (v == g->value[i][j])
+          continue;
+        ++n;
+        if (wk->threads > 1)
+          fprintf(f, "    %d:%s = %d\n", i, j < t_max? reg[i].t_name[j]:
+            reg[i].s_name[j - t_max], v);
+        else
+          fprintf(f, "    %s = %d\n", j < t_max? reg[i].t_name[j]:
+            reg[i].s_name[j - t_max], v);
+      }
+    if (n == 0 && (g->part & golden_regs))
+      fprintf(f, "    no register is written\n");
+    fclose(f);
+  }
+  for (i = 0; i < wk->threads; ++i)
+    for (j = 0; j < t_max + s_max; ++j)
+      g->value[i][j] = j < t_max? reg[i].t[j]: reg[i].s[j - t_max];
+}
+
+int golden_save(struct golden *g, struct config *cfg, struct registers reg[],
+  const char *path[]) {
+  int i, j, bad;
+  FILE *out = g->out;
+  unsigned long long end[2];
+  fwrite(golden_magic, 1, 4, out);
+  fputc(golden_version, out);
+  put_varint(out, cfg->forwarding);
+  put_varint(out, cfg->policy);
+  put_varint(out, cfg->limit);
+  put_varint(out, cfg->threads);
+  // the programs are found next to the golden run, by their names
+  for (i = 0; i < cfg->threads; ++i) {
+    const char *name = strrchr(path[i], '/')? strrchr(path[i], '/') + 1:
+      path[i];
+    put_varint(out, strlen(name));
+    fwrite(name, 1, strlen(name), out);
+  }
+  put_varint(out, g->count);
+  for (i = 0; i < g->count; ++i)
+    for (j = 0; j < 4; ++j)             // little endian
+      fputc((int)(g->hash[i] >> (j << 3) & 0xff), out);
+  end[0] = g->stages;                   // the whole hashes of the run
+  end[1] = g->regs;
+  for (i = 0; i < 2; ++i)
+    for (j = 0; j < 8; ++j)
+      fputc((int)(end[i] >> (j << 3) & 0xff), out);
+  for (i = 0; i < cfg->threads; ++i)
+    for (j = 0; j < t_max + s_max; ++j)
+      put_varint(out, zigzag(j < t_max? reg[i].t[j]: reg[i].s[j - t_max]));
+  free(g->hash);
+  g->hash = NULL;
+  bad = ferror(out);
+  if (fclose(out))
+    bad = 1;
+  return bad? -1: 0;
+}
+
+int run_golden(const char *dir) {
+  int i, workers, size = 0, failed = 0;
+  size_t len = strlen(golden_suffix);
+  struct golden_run gr;
+  struct dirent *e;
+  pthread_t thread[chunk_max];
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    fprintf(stderr, "ERROR: cannot open directory %s.\n", dir);
+    return EXIT_FAILURE;
+  }
+  memset(&gr, 0, sizeof(gr));
+  gr.dir = dir;
+  while ((e = readdir(d)) != NULL) {
+    size_t n = strlen(e->d_name);
+    if (n < len || n >= buffer_size
+      || strcmp(e->d_name + n - len, golden_suffix))
+      continue;
+    if (gr.count == size) {
+      size = size? size << 1: 64;
+      gr.job = realloc(gr.job, sizeof(struct golden_job) * size);
+      assert(gr.job != NULL);
+    }
+    memset(&gr.job[gr.count], 0, sizeof(struct golden_job));
+    strcpy(gr.job[gr.count++].name, e->d_name);
+  }
+  closedir(d);
+  qsort(gr.job, gr.count, sizeof(struct golden_job), golden_compare);
+
+  // check the golden runs on a pool of workers, and print them in order
+  gr.next = 0;
+  pthread_mutex_init(&gr.lock, NULL);
+  workers = chunk_count((size_t)-1);   // one worker for every core
+  if (workers > gr.count)
+    workers = gr.count;
+  for (i = 1; i < workers; ++i)
+    if (pthread_create(&thread[i], NULL, golden_worker, &gr) != 0)
+      break;
+  workers = i;
+  golden_worker(&gr);
+  for (i = 1; i < workers; ++i)
+    pthread_join(thread[i], NULL);
+  pthread_mutex_destroy(&gr.lock);
+  for (i = 0; i < gr.count; ++i) {
+    fwrite(gr.job[i].report, 1, gr.job[i].report_size, stdout);
+    failed += gr.job[i].failed;
+    free(gr.job[i].report);
+  }
+  printf("%d golden runs, %d the same, %d different\n", gr.count,
+    gr.count - failed, failed);
+  free(gr.job);
+  return failed? EXIT_FAILURE: EXIT_SUCCESS;
+}
+
+void *golden_worker(void *arg) {
+  struct golden_run *gr = arg;
+  for (;;) {
+    int n;
+    pthread_mutex_lock(&gr->lock);
+    n = gr->next++;
+    pthread_mutex_unlock(&gr->lock);
+    if (n >= gr->count)
+      break;
+    golden_check(gr->dir, &gr->job[n]);
+  }
+  return NULL;
+}
+
+void golden_check(const char *dir, struct golden_job *job) {
+  // variable declaration
+  FILE *in, *report;
+  char path[buffer_size * 8], magic[4];
+  char name[thread_max][buffer_size];
+  int i, j, len, err = 0;
+  int value[thread_max][t_max + s_max]; // final registers of the golden run
+  unsigned long long stages = 0, regs = 0;
+  struct config cfg;
+  struct golden g;
+  struct stats st;
+  struct registers reg[thread_max];
+  struct instructions ins[thread_max];
+
+  report = open_memstream(&job->report, &job->report_size);
+  assert(report != NULL);
+  job->failed = 1;
+  memset(&cfg, 0, sizeof(cfg));
+  memset(&g, 0, sizeof(g));
+  snprintf(path, sizeof(path), "%s/%s", dir, job->name);
+  in = fopen(path, "rb");
+  if (in == NULL) {
+    fprintf(report, "ERROR %s: cannot open file.\n", job->name);
+    fclose(report);
+    return;
+  }
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, golden_magic, 4)
+    || fgetc(in) != golden_version)
+    err = 1;
+  if (!err) {
+    cfg.forwarding = (int)tl_get_varint(in);
+    cfg.policy = (int)tl_get_varint(in);
+    cfg.limit = (int)tl_get_varint(in);
+    cfg.threads = (int)tl_get_varint(in);
+    err = cfg.threads < 1 || cfg.threads > thread_max || cfg.limit < 0;
+  }
+  for (i = 0; !err && i < cfg.threads; ++i) {
+    len = (int)tl_get_varint(in);
+    err = len < 1 || len >= buffer_size
+      || fread(name[i], 1, len, in) != (size_t)len;
+    if (!err)
+      name[i][len] = '\0';
+  }
+  if (!err) {
+    g.count = (int)tl_get_varint(in);
+    g.hash = g.count >= 0? malloc(sizeof(unsigned) * (g.count + 1)): NULL;
+    err = g.hash == NULL;
+  }
+  if (!err) {
+    for (i = 0; i < g.count; ++i)
+      g.hash[i] = (unsigned)tl_get(in, 4);
+    stages = tl_get(in, 8);
+    regs = tl_get(in, 8);
+    for (i = 0; i < cfg.threads; ++i)
+      for (j = 0; j < t_max + s_max; ++j)
+        value[i][j] = (int)unzigzag(tl_get_varint(in));
+    err = feof(in);
+  }
+  fclose(in);
+  if (err) {
+    fprintf(report, "ERROR %s: invalid golden run.\n", job->name);
+    free(g.hash);
+    fclose(report);
+    return;
+  }
+
+  // the programs as the golden run has them
+  for (i = 0; i < cfg.threads; ++i) {
+    snprintf(path, sizeof(path), "%s/%s", dir, name[i]);
+    data_init(&reg[i], &ins[i]);
+    err = load_program(path, &ins[i]);
+    if (err == -1)
+      fprintf(report, "ERROR %s: cannot open %s.\n", job->name, name[i]);
+    else if (err == -2)
+      fprintf(report, "ERROR %s: out of memory.\n", job->name);
+    else if (err > 0)
+      fprintf(report, "ERROR %s: invalid instruction at line %d of %s.\n",
+        job->name, err, name[i]);
+    else {
+      err = label_preprocess(&ins[i]);
+      if (err == 0 && (err = label_check(&ins[i])) > 0)
+        fprintf(report, "ERROR %s: undefined label at line %d of %s.\n",
+          job->name, err, name[i]);
+      else if (err == 0)
+        err = threaded_lower(&ins[i]);
+      if (err == -1)
+        fprintf(report, "ERROR %s: out of memory.\n", job->name);
+    }
+    if (err) {
+      for (j = 0; j <= i; ++j)
+        program_free(&ins[j]);
+      free(g.hash);
+      fclose(report);
+      return;
+    }
+  }
+
+  // the run goes one cycle past the golden one at most, to tell that it is
+  // longer
+  if (cfg.limit == 0 || cfg.limit > g.count + 1)
+    cfg.limit = g.count + 1;
+  cfg.report = report;
+  cfg.golden = &g;
+  g.stages = 14695981039346656037ULL;
+  g.regs = 14695981039346656037ULL;
+  if (pipeline(reg, ins, &cfg, &st)) {
+    fprintf(report, "ERROR %s: out of memory.\n", job->name);
+    free(g.focus);
+    free(g.hash);
+    for (i = 0; i < cfg.threads; ++i)
+      program_free(&ins[i]);
+    fclose(report);
+    return;
+  }
+  if (!g.diverged && g.cycles < g.count) {
+    g.diverged = g.cycles + 1;
+    g.part = golden_end;
+  }
+  if (!g.diverged && (g.stages != stages || g.regs != regs)) {
+    g.diverged = g.cycles;              // only the whole hashes differ
+    g.part = (g.stages != stages? golden_stages: 0)
+      | (g.regs != regs? golden_regs: 0);
+  }
+
+  if (!g.diverged) {
+    fprintf(report, "SAME %s, %d cycles\n", job->name, g.cycles);
+    job->failed = 0;
+  } else {
+    fprintf(report, "DIFFERENT %s from cycle %d", job->name, g.diverged);
+    if (g.part == golden_end && g.cycles > g.count)
+      fprintf(report, ", after the end of the golden run\n");
+    else if (g.part == golden_end)
+      fprintf(report, ", after the end of this run\n");
+    else if (g.part == golden_stages)
+      fprintf(report, ", in the stages\n");
+    else if (g.part == golden_regs)
+      fprintf(report, ", in the registers\n");
+    else
+      fprintf(report, ", in the stages and the registers\n");
+    if (g.focus) {
+      fprintf(report, "  this run in cycle %d:\n", g.diverged);
+      fwrite(g.focus, 1, g.focus_size, report);
+    }
+    for (i = 0; i < cfg.threads; ++i)
+      for (j = 0; j < t_max + s_max; ++j) {
+        int v = j < t_max? reg[i].t[j]: reg[i].s[j - t_max];
+        if (v == value[i][j])
+          continue;
+        fprintf(report, "  at the end, ");
+        if (cfg.threads > 1)
+          fprintf(report, "%d:", i);
+        fprintf(report, "%s = %d instead of %d\n", j < t_max?
+          reg[i].t_name[j]: reg[i].s_name[j - t_max], v, value[i][j]);
+      }
+  }
+  free(g.focus);
+  free(g.hash);
+  for (i = 0; i < cfg.threads; ++i)
+    program_free(&ins[i]);
+  fclose(report);
+}
+
+int golden_compare(const void *a, const void *b) {
+  return strcmp(((const struct golden_job *)a)->name,
+    ((const struct golden_job *)b)->name);
+}
+
+struct p1_sim *p1_create(int forwarding, int policy) {
+  struct p1_sim *sim;
+  if (policy != policy_rr && policy != policy_icount)
+    return NULL;
+  // nothing is printed or recorded, and the run has no limit of cycles
+  sim = calloc(1, sizeof(struct p1_sim));
+  if (sim == NULL)
+    return NULL;
+  sim->cfg.forwarding = forwarding? 1: 0;
+  sim->cfg.policy = policy;
+  return sim;
+}
+
+int p1_load(struct p1_sim *sim, const char *path, int *line) {
+  struct instructions *ins;
+  int err, label = 0;
+  if (sim == NULL || path == NULL)
+    return p1_error_argument;
+  if (sim->started)
+    return p1_error_state;
+  if (sim->cfg.threads == thread_max)
+    return p1_error_full;
+  ins = &sim->ins[sim->cfg.threads];
+  data_init(&sim->reg[sim->cfg.threads], ins);
+  err = load_program(path, ins);
+  if (err == 0 && label_preprocess(ins))
+    err = -2;                           // out of memory, as load_program()
+  // a taken branch to no label would stop the pipeline
+  if (err == 0 && (err = label_check(ins)) > 0)
+    label = 1;
+  if (err == 0 && threaded_lower(ins))
+    err = -2;
+  if (err == 0) {
+    ++sim->cfg.threads;
+    return 0;
+  }
+  program_free(ins);
+  if (err == -1)
+    return p1_error_open;
+  if (err == -2)
+    return p1_error_memory;
+  if (line != NULL)
+    *line = err;
+  return label? p1_error_label: p1_error_program;
+}
+
+int p1_step(struct p1_sim *sim, int cycles) {
+  struct machine *m;
+  long long target;
+  int status = 0;
+  if (sim == NULL || cycles < 0)
+    return p1_error_argument;
+  if (sim->cfg.threads == 0)
+    return p1_error_state;
+  m = &sim->m;
+  if (!sim->started) {
+    if (machine_begin(m, sim->reg, sim->ins, &sim->cfg, &sim->st,
+      source_execute, output_none))
+      return p1_error_memory;
+    sim->started = 1;
+  }
+  if (!sim->ended) {
+    // the limit also stops a loop fast-forwarded at the last cycle to step
+    target = (long long)m->wk.base + m->time + cycles;
+    sim->cfg.limit = target > INT_MAX? INT_MAX: (int)target;
+    while (m->wk.base + m->time < sim->cfg.limit)
+      if ((status = machine_step(m))) {
+        // -1 if out of memory, and the next step goes on without
+        // fast-forward
+        sim->ended = status == 1;
+        break;
+      }
+    if (sim->ended)
+      machine_end(m, output_none);
+    else
+      sim->st.cycles = m->wk.base + m->time;
+    if (status == -1)
+      return p1_error_memory;
+  }
+  if (!sim->ended)
+    return p1_running;
+  return sim->st.livelock? p1_livelock: p1_done;
+}
+
+int p1_run(struct p1_sim *sim) {
+  int status;
+  do
+    status = p1_step(sim, 1 << 20);
+  while (status == p1_running);
+  return status;
+}
+
+int p1_registers(struct p1_sim *sim, int thread, int value[p1_register_count]) {
+  int i;
+  if (sim == NULL || value == NULL || thread < 0 || thread >= sim->cfg.threads)
+    return p1_error_argument;
+  for (i = 0; i < t_max; ++i)
+    value[i] = sim->reg[thread].t[i];
+  for (i = 0; i < s_max; ++i)
+    value[t_max + i] = sim->reg[thread].s[i];
+  return 0;
+}
+
+int p1_stats(struct p1_sim *sim, struct p1_stats *stats) {
+  int i;
+  if (sim == NULL || stats == NULL)
+    return p1_error_argument;
+  memset(stats, 0, sizeof(*stats));
+  stats->cycles = sim->st.cycles;
+  for (i = 0; i < thread_max; ++i)
+    stats->retired[i] = sim->st.retired[i];
+  stats->nops = sim->st.nops;
+  stats->flushed = sim->st.flushed;
+  stats->stalls = sim->st.stalls;
+  stats->skipped = sim->st.skipped;
+  stats->livelock = sim->st.livelock;
+  return 0;
+}
+
+void p1_destroy(struct p1_sim *sim) {
+  int i;
+  if (sim == NULL)
+    return;
+  if (sim->started && !sim->ended)
+    machine_end(&sim->m, output_none);
+  for (i = 0; i < sim->cfg.threads; ++i)
+    program_free(&sim->ins[i]);
+  free(sim);
 }
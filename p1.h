@@ -0,0 +1,68 @@
+#ifndef P1_H
+#define P1_H
+
+
+/*
+  The simulator as a library, for embedding in other programs. Every
+  simulation is an opaque handle which holds all of its state, nothing is
+  printed, and errors are returned as codes, so simulations can run
+  concurrently in one process, one handle per thread at a time.
+*/
+
+
+#define p1_thread_max 4                 // max count of programs in a handle
+#define p1_register_count 18            // $t0 to $t9, then $s0 to $s7
+#define p1_policy_rr 0                  // round-robin fetch between programs
+#define p1_policy_icount 1              // ICOUNT fetch between programs
+#define p1_running 0                    // the simulation can go on
+#define p1_done 1                       // every instruction is done
+#define p1_livelock 2                   // done, but a program never ends
+#define p1_error_argument -1            // invalid handle, thread or count
+#define p1_error_open -2                // the file cannot be opened
+#define p1_error_program -3             // invalid instruction in the program
+#define p1_error_label -4               // branch to a label not defined
+#define p1_error_full -5                // p1_thread_max programs are loaded
+#define p1_error_state -6               // no program, or already started
+#define p1_error_memory -7              // out of memory
+
+
+struct p1_sim;
+
+struct p1_stats {
+  int cycles;                           // cycles simulated so far
+  int retired[p1_thread_max];           // instructions of each program in WB
+  int nops;                             // nops inserted for data hazards
+  int flushed;                          // instructions invalidated by branches
+  int stalls;                           // cycles stalled by data hazards
+  int skipped;                          // iterations of loops fast-forwarded
+  int livelock;                         // count of programs never ending
+};
+
+
+struct p1_sim *p1_create(int forwarding, int policy);
+// p1_create() will return a new simulation, with forwarding if forwarding is
+// not 0 and the fetch policy between programs, or NULL if out of memory
+int p1_load(struct p1_sim *sim, const char *path, int *line);
+// p1_load() will load the program at path as the next hardware thread, and
+// return 0 on success or an error code. for p1_error_program and
+// p1_error_label, the line number is written to line if it is not NULL.
+// programs can only be loaded before the first step
+int p1_step(struct p1_sim *sim, int cycles);
+// p1_step() will simulate up to the given count of cycles, and return
+// p1_running, p1_done, p1_livelock or an error code. after p1_error_memory,
+// the simulation can go on with the next step
+int p1_run(struct p1_sim *sim);
+// p1_run() will simulate until every program is done or never ends, and
+// return p1_done, p1_livelock or an error code. a program which runs forever
+// without repeating its state never returns, use p1_step() for a bound
+int p1_registers(struct p1_sim *sim, int thread, int value[p1_register_count]);
+// p1_registers() will write the registers of the program of thread to value,
+// and return 0 or an error code
+int p1_stats(struct p1_sim *sim, struct p1_stats *stats);
+// p1_stats() will write the statistics so far to stats, and return 0 or an
+// error code
+void p1_destroy(struct p1_sim *sim);
+// p1_destroy() will free the simulation and its programs
+
+
+#endif
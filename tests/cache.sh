@@ -0,0 +1,36 @@
+#!/bin/sh
+# a result printed from the cache has to be the output of the run. -u has to
+# run again instead of printing the result, and replace it. the results kept
+# cannot take more than the bound once it is passed
+p1=$1
+dir=$2/cache
+status=0
+rm -rf "$dir"
+"$p1" F ex01.s -z 1 "$dir" > "$dir.miss"
+"$p1" F ex01.s -z 1 "$dir" > "$dir.hit"
+if ! cmp -s "$dir.miss" "$dir.hit"; then
+  echo "ex01.s: the result from the cache differs from the run"
+  status=1
+fi
+# a result changed in the cache is printed as it is, but not with -u
+sed -i 's/START OF/CACHE OF/' "$dir"/*.p1r
+if ! "$p1" F ex01.s -z 1 "$dir" | grep -q '^CACHE OF'; then
+  echo "ex01.s: the result is not printed from the cache"
+  status=1
+fi
+"$p1" F ex01.s -z 1 "$dir" -u > "$dir.update"
+"$p1" F ex01.s -z 1 "$dir" > "$dir.hit"
+if ! cmp -s "$dir.miss" "$dir.update" || ! cmp -s "$dir.miss" "$dir.hit"; then
+  echo "ex01.s: -u does not run again and replace the result"
+  status=1
+fi
+# results of about 300 KB each, more than 1 MB together
+for limit in 100 101 102 103 104 105 106; do
+  "$p1" F tests/loop.s -l $limit -z 1 "$dir" > /dev/null
+done
+size=$(cat "$dir"/*.p1r | wc -c)
+if [ "$size" -eq 0 ] || [ "$size" -gt 1048576 ]; then
+  echo "tests/loop.s: the results take $size bytes for a bound of 1 MB"
+  status=1
+fi
+exit $status
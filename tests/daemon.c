@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/*
+  A job with an invalid program has to get an error back, and leave the
+  daemon and the connection working for the next jobs. The argument is the
+  socket of a daemon already listening.
+*/
+
+
+struct job {
+  const char *text;                     // the program
+  int status;                           // the exit status of the response
+  const char *output;                   // the start of the output
+};
+
+static const struct job job[] = {
+  {"add $t0,$zero,1\nadd $t1,$a0,$t2\n", 1,
+    "ERROR: invalid instruction at line 2.\n"},
+  {"add $t0,$zero,1\nadd $zero,$t0,5\n", 1,
+    "ERROR: invalid instruction at line 2.\n"},
+  {"xor $t3,$t2,$t0\n", 1, "ERROR: invalid instruction at line 1.\n"},
+  {"beq $t0,$t0,nowhere\n", 1, "ERROR: undefined label at line 1.\n"},
+  {"addi $t0,$zero,7\n", 0, "---"}
+};
+
+// read_all() will read size bytes from fd, and return -1 if it ends before
+static int read_all(int fd, char *buffer, long size) {
+  while (size > 0) {
+    ssize_t n = read(fd, buffer, size);
+    if (n <= 0)
+      return -1;
+    buffer += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// run_job() will send the job on fd and check its response, and return 1 if
+// it is not the expected one
+static int run_job(int fd, const struct job *jb) {
+  char line[256], *output;
+  int i, status;
+  long size;
+  snprintf(line, sizeof(line), "F -n %lu\n", (unsigned long)strlen(jb->text));
+  if (write(fd, line, strlen(line)) < 0
+    || write(fd, jb->text, strlen(jb->text)) < 0)
+    return 1;
+  // the response is "<status> <bytes>" and the bytes of the output
+  for (i = 0; i < (int)sizeof(line) - 1; ++i)
+    if (read(fd, &line[i], 1) != 1 || line[i] == '\n')
+      break;
+  line[i] = '\0';
+  if (sscanf(line, "%d %ld", &status, &size) != 2 || size < 0)
+    return 1;
+  output = malloc(size + 1);
+  if (output == NULL || read_all(fd, output, size)) {
+    free(output);
+    return 1;
+  }
+  output[size] = '\0';
+  i = status != jb->status
+    || strncmp(output, jb->output, strlen(jb->output)) != 0;
+  if (i)
+    printf("status %d and output %s", status, output);
+  free(output);
+  return i;
+}
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  int i, fd, failed = 0;
+  int count = (int)(sizeof(job) / sizeof(job[0]));
+  if (argc != 2) {
+    fprintf(stderr, "ERROR: incorrect number of inputs.\n");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);             // a daemon which ended is a failure
+  // every job on one connection, then the valid one again on a new one
+  fd = connect_to(argv[1]);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: cannot connect to %s.\n", argv[1]);
+    return 1;
+  }
+  for (i = 0; i < count; ++i)
+    if (run_job(fd, &job[i])) {
+      printf("job %d: not the expected response\n", i);
+      failed = 1;
+    }
+  close(fd);
+  fd = connect_to(argv[1]);
+  if (fd < 0 || run_job(fd, &job[count - 1])) {
+    printf("the daemon does not answer after the invalid jobs\n");
+    failed = 1;
+  }
+  if (fd >= 0)
+    close(fd);
+  return failed;
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+# start a daemon, and send it invalid jobs and valid ones
+p1=$1
+dir=$2
+gcc -O2 -o "$dir/daemon" tests/daemon.c || exit 1
+"$p1" -d "$dir/socket" > /dev/null 2>&1 &
+daemon=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S "$dir/socket" ] && break
+  sleep 0.2
+done
+"$dir/daemon" "$dir/socket"
+status=$?
+kill $daemon
+wait $daemon 2> /dev/null
+exit $status
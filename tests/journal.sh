@@ -0,0 +1,29 @@
+#!/bin/sh
+# the tables rebuilt from the journal of a run have to be the same as the ones
+# printed by the run, for the example programs, for two threads and for a loop
+# run long enough that the window slides
+p1=$1
+dir=$2
+status=0
+check() {
+  "$p1" "$@" > "$dir/tables.txt" || return 1
+  "$p1" "$@" -j | "$p1" -y - | cmp -s - "$dir/tables.txt"
+}
+for f in tests/expected/*.out; do
+  name=$(basename "$f" .out)
+  program=${name%.*}.s
+  mode=${name##*.}
+  if ! check "$mode" "$program"; then
+    echo "$program $mode: the tables differ from the journal"
+    status=1
+  fi
+done
+if ! check F ex01.s p1-ex02.s -l 0; then
+  echo "ex01.s p1-ex02.s: the tables differ from the journal"
+  status=1
+fi
+if ! check N tests/loop.s -l 0; then
+  echo "tests/loop.s: the tables differ from the journal"
+  status=1
+fi
+exit $status
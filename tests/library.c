@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "../p1.h"
+
+
+/*
+  The library has to return an error with the line number for every program
+  it cannot simulate, instead of ending the process, and run a valid one to
+  its end. The programs are written to the directory given as the argument.
+*/
+
+
+struct invalid {
+  const char *text;                     // the program
+  int error;                            // the code p1_load() returns
+  int line;                             // the line number it gives
+};
+
+static const struct invalid invalid[] = {
+  {"add $t0,$zero,1\nadd $t1,$a0,$t2\n", p1_error_program, 2},
+  {"add $zero,$t0,5\n", p1_error_program, 1},
+  {"add 5,$t0,$t1\n", p1_error_program, 1},
+  {"addi $t2,$zero,3\naddi $t0,$zero,7\nxor $t3,$t2,$t0\n",
+    p1_error_program, 3},
+  {"add $t0,$zero,1\nbgt $t0,$zero,end\nend:\n", p1_error_program, 2},
+  {"add $t10,$t0,1\n", p1_error_program, 1},
+  {"add $t1,$t0,2147483648\n", p1_error_program, 1},
+  {"add $t1,$t0\n", p1_error_program, 1},
+  {"add $t0,$zero,1\nbeq $t0,$t0,nowhere\n", p1_error_label, 2}
+};
+
+int main(int argc, char **argv) {
+  // variable declaration
+  char path[4096];
+  int i, line, err, failed = 0;
+  int value[p1_register_count];
+  struct p1_sim *sim;
+  FILE *out;
+
+  if (argc != 2) {
+    fprintf(stderr, "ERROR: incorrect number of inputs.\n");
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s/program.s", argv[1]);
+  for (i = 0; i < (int)(sizeof(invalid) / sizeof(invalid[0])); ++i) {
+    out = fopen(path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "ERROR: cannot write file.\n");
+      return 1;
+    }
+    fputs(invalid[i].text, out);
+    fclose(out);
+    sim = p1_create(1, p1_policy_rr);
+    line = 0;
+    err = p1_load(sim, path, &line);
+    if (err != invalid[i].error || line != invalid[i].line) {
+      printf("program %d: error %d at line %d instead of %d at line %d\n", i,
+        err, line, invalid[i].error, invalid[i].line);
+      failed = 1;
+    }
+    // nothing is loaded, so the simulation cannot start
+    if (p1_run(sim) != p1_error_state) {
+      printf("program %d: the simulation starts without a program\n", i);
+      failed = 1;
+    }
+    p1_destroy(sim);
+  }
+
+  // a valid program runs to its end, the sum of 1 to 100 is in $s0
+  sim = p1_create(1, p1_policy_rr);
+  err = p1_load(sim, "tests/loop.s", NULL);
+  if (err == 0)
+    err = p1_run(sim);
+  if (err == p1_done)
+    err = p1_registers(sim, 0, value);
+  if (err != 0 || value[10] != 5050) {
+    printf("tests/loop.s: error %d, $s0 = %d instead of 5050\n", err,
+      err? 0: value[10]);
+    failed = 1;
+  }
+  p1_destroy(sim);
+  return failed;
+}
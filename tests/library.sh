@@ -0,0 +1,6 @@
+#!/bin/sh
+# build the library test with the simulator compiled as a library, and run it
+dir=$2
+gcc -O2 -Dp1_library -o "$dir/library" tests/library.c p1.c -lpthread -lm \
+  || exit 1
+"$dir/library" "$dir"
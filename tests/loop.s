@@ -0,0 +1,8 @@
+# 100 iterations of a loop, whose sum depends on the counter just written
+addi $t0,$zero,100
+add $t1,$zero,$zero
+add $s0,$zero,$zero
+loop:
+addi $t1,$t1,1
+add $s0,$s0,$t1
+bne $t1,$t0,loop
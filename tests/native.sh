@@ -0,0 +1,29 @@
+#!/bin/sh
+# the programs which end have to end with the same registers when executed by
+# the native code, by the threaded code (built with -Djit_none) and in the
+# pipeline. ex05.s never ends, so the native and threaded code execute it up
+# to the same count of instructions
+p1=$1
+dir=$2
+status=0
+gcc -O2 -Djit_none -o "$dir/threaded" p1.c -lpthread -lm || exit 1
+registers() {
+  grep '^\$'
+}
+for program in ex0[1-4].s ex31.s p1-ex0*.s tests/*.s; do
+  native=$("$p1" F "$program" -f 0 | registers)
+  threaded=$("$dir/threaded" F "$program" -f 0 | registers)
+  pipeline=$("$p1" F "$program" -n -l 0 | registers)
+  if [ -z "$native" ] || [ "$native" != "$threaded" ] \
+    || [ "$native" != "$pipeline" ]; then
+    echo "$program: the registers differ"
+    status=1
+  fi
+done
+native=$("$p1" F ex05.s -f 100000 | registers)
+threaded=$("$dir/threaded" F ex05.s -f 100000 | registers)
+if [ -z "$native" ] || [ "$native" != "$threaded" ]; then
+  echo "ex05.s: the registers differ"
+  status=1
+fi
+exit $status
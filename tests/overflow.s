@@ -0,0 +1,13 @@
+# sums wrap around at 32 bits, and slt compares them as negative
+addi $t0,$zero,2147483647
+addi $t1,$t0,1
+add $t2,$t1,$t1
+addi $t3,$zero,-2147483648
+slt $s0,$t1,$zero
+slt $s1,$zero,$t1
+slti $s2,$t1,-5
+slt $s3,-3,$t1
+slt $s4,$t0,$t1
+and $t4,$t1,-1
+or $t5,$t3,-7
+addi $t6,$t5,-2147483648
@@ -0,0 +1,16 @@
+#!/bin/sh
+# the tables of the example programs, with and without forwarding, have to be
+# the same as the ones of the first version of the simulator, which are kept
+# in tests/expected as <program>.<F|N>.out
+p1=$1
+status=0
+for f in tests/expected/*.out; do
+  name=$(basename "$f" .out)
+  program=${name%.*}.s
+  mode=${name##*.}
+  if ! "$p1" "$mode" "$program" | cmp -s - "$f"; then
+    echo "$program $mode: the table differs from $f"
+    status=1
+  fi
+done
+exit $status
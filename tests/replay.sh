@@ -0,0 +1,29 @@
+#!/bin/sh
+# a loop of more than 64 instructions has to take the same cycles and
+# instructions when it is executed, when its captured trace is replayed and in
+# a sweep, with and without forwarding. a trace which is cut cannot be replayed
+p1=$1
+dir=$2
+status=0
+summary() {
+  sed -n 's/^cycles: \([0-9]*\), instructions: \([0-9]*\),.*/\1 \2/p'
+}
+"$p1" F tests/loop.s -c "$dir/loop.trace" > /dev/null || exit 1
+"$p1" F tests/loop.s -l 0 -x forwarding=F,N > "$dir/sweep.txt" || exit 1
+for mode in F N; do
+  executed=$("$p1" $mode tests/loop.s -l 0 -n | summary)
+  replayed=$("$p1" $mode tests/loop.s -l 0 -n -r "$dir/loop.trace" | summary)
+  swept=$(awk -v m=$mode '$1 == m && $2 == "no" { print $4, $5 }' \
+    "$dir/sweep.txt")
+  if [ -z "$executed" ] || [ "$executed" != "$replayed" ] \
+    || [ "$executed" != "$swept" ]; then
+    echo "$mode: executed $executed, replayed $replayed, swept $swept"
+    status=1
+  fi
+done
+"$p1" F ex05.s -c "$dir/endless.trace" > /dev/null || exit 1
+if "$p1" F ex05.s -r "$dir/endless.trace" > /dev/null 2>&1; then
+  echo "the cut trace of ex05.s is replayed"
+  status=1
+fi
+exit $status
@@ -0,0 +1,19 @@
+#!/bin/sh
+# build the simulator, then run every test against it. the exit status is 1 if
+# any test fails
+cd "$(dirname "$0")/.." || exit 1
+build=${TMPDIR:-/tmp}/p1-tests.$$
+mkdir -p "$build" || exit 1
+trap 'rm -rf "$build"' EXIT
+gcc -O2 -o "$build/p1" p1.c -lpthread -lm || exit 1
+status=0
+for t in tests/*.sh; do
+  [ "$t" = tests/run.sh ] && continue
+  if sh "$t" "$build/p1" "$build"; then
+    echo "PASS $t"
+  else
+    echo "FAIL $t"
+    status=1
+  fi
+done
+exit $status
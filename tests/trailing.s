@@ -0,0 +1,10 @@
+# the branches out of the loop jump to the label after the last instruction
+addi $t0,$zero,5
+loop:
+addi $t0,$t0,-1
+addi $s0,$s0,2
+beq $t0,$zero,end
+bne $s0,6,loop
+beq $zero,$zero,end
+addi $s1,$zero,1
+end: